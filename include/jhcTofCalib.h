@@ -0,0 +1,121 @@
+// jhcTofCalib.h : finds relative poses of several sensors from shared planes
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <pthread.h>
+
+#include <jhcTofCloud.h>
+#include <jhcTofPlanes.h>
+
+
+//= Finds relative poses of several sensors from shared planes.
+// for each set of simultaneous frames every sensor finds its large planes
+// (in parallel threads), then each sensor is aligned to sensor 0 by matching
+// its planes to those of sensor 0 in the same frame set using rough poses
+// rotation comes from matched normals (Horn quaternion method) and position
+// from plane offsets, needing 3 or more independent normals overall
+// directions not constrained by planes are kept at the rough guess
+// matching tolerances shrink over several rounds as the poses improve
+// sensor 0 pose defines world frame and is never changed
+// poses use jhcTofCloud conventions (x y z in mm, pan tilt roll in degrees)
+
+class jhcTofCalib
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // plane finding for each sensor
+  jhcTofCloud cloud[8];
+  jhcTofPlanes planes[8];
+  const unsigned char *img[8];
+  int ns;
+
+  // thread arguments (object and sensor)
+  struct calib_job {jhcTofCalib *me; int sensor;} job[8];
+
+  // camera frame planes (nx, ny, nz, d) and support for each frame set
+  float pl[8][100][12][4];
+  int pw[8][100][12], npl[8][100], nf;
+
+  // rough and solved poses (x, y, z, pan, tilt, roll)
+  float guess[8][6], pose[8][6];
+  float aerr[8], derr[8];
+  int nmat[8], fixed[8];
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // planes used (min pixels)
+  int pmin;
+
+  // matching tolerances (initial and final degrees and mm)
+  float atol, dtol, amin, dmin;
+
+  // solution rounds and pull toward guess for unconstrained directions
+  int rounds;
+  float reg;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofCalib ();
+  void Reset (int n);
+  void SetGuess (int s, float x, float y, float z, float pan, float tilt, float roll);
+  void SetGuess (int s, const jhcTofCloud& src);
+
+  // main functions
+  int AddFrame (const unsigned char * const *range);
+  int Solve ();
+
+  // results
+  int Sensors () const {return ns;}
+  int Frames () const {return nf;}
+  int Pose (float *p, int s) const;
+  int Matches (int s) const {return(((s >= 0) && (s < ns)) ? nmat[s] : 0);}
+  float AngErr (int s) const {return(((s >= 0) && (s < ns)) ? aerr[s] : 0.0f);}
+  float OffErr (int s) const {return(((s >= 0) && (s < ns)) ? derr[s] : 0.0f);}
+
+  // configuration file
+  int Save (const char *fname) const;
+  static int Load (jhcTofCloud& dest, const char *fname, int s);
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  // plane finding
+  static void *finder (void *arg);
+  void find_planes (int s);
+
+  // alignment
+  int align (int s);
+  int match (int *mate, int s, int f, const double *r, const double *c, float at, float dt) const;
+  void world_plane (double *nw, double& dw, const float *p, const double *r, const double *c) const;
+  int fit_rot (double *r, const double *sum, const double *a) const;
+  void fit_pos (double *c, const double *a, const double *b, const double *c0) const;
+  void jacobi (double *val, double *vec, double *m, int n) const;
+
+  // pose conversion
+  static void pose2mat (double *r, const float *p);
+  static void mat2pose (float *p, const double *r);
+
+};
@@ -24,9 +24,37 @@
 
 #include <pthread.h>
 
+#include <jhcTofClock.h>
+#include <jhcUringRx.h>
+#include <jhcTofTee.h>
+
+
+//= Information about sensor frame that travels with its depth image.
+
+struct jhcTofMeta
+{
+  long long tstamp;                    // corrected capture time (ns)
+  float terr;                          // timestamp uncertainty (ms)
+  int fid;                             // sensor frame id (12 bits)
+  float valid;                         // fraction of pixels reported
+  float satd;                          // fraction of sensor saturated
+  float mvar;                          // mean variance of valid (mm^2)
+  float motion;                        // fraction blanked for flicker
+  int jump;                            // range step just changed
+  float ttc;                           // min time-to-contact in ROI (s)
+  int tx, ty;                          // pixel with min time-to-contact
+  int outs;                            // optional outputs computed
+  int step;                            // depth of one histogram bin (mm)
+  int hist[256];                       // sensor values over whole frame
+  int rhist[256];                      // sensor values in auto-range ROI
+  float dpct[3], rpct[3];              // 10 50 90 percentile depth (mm)
+};
+
 
 //= Interface to Sipeed MaixSense A010 Time-of-Flight sensor.
-// rotates through 3 element image buffers: xfill, xdone, xlock
+// fills images from a pool, each subscriber has a pending and a locked one
+// subscribers give a frame rate and which optional outputs they need
+// optional outputs are only computed for frames some subscriber will get
 // uses faster median algorithm with partial histogram scans
 // pipelines spatial and temporal filters for lower latency
 
@@ -35,36 +63,76 @@ class jhcTofCam
 // PRIVATE MEMBER VARIABLES
 private:
   // camera connection and health
-  int ser, ok;  
+  int ser, live, ok;  
 
   // background receiver and pre-processing
   pthread_t hoover;
   pthread_mutex_t data;
   int run;
 
+  // serial input buffering and recording
+  jhcTofTee tee;
+  jhcUringRx urx;
+  unsigned char rbuf[4096];
+  unsigned char *rx;
+  int rn;
+
   // sensor input image
   unsigned char pkt[10018];
   unsigned char *raw;
 
+  // padded copy of input (128 byte rows, 2 pixel border, 64 byte aligned)
+  unsigned char rbox[13504];
+  unsigned char *rp;
+
+  // frame timing
+  jhcTofClock clk;
+  long long arrive, tpace;
+  int pid;
+
   // auto-ranging
-  int cent[256];
-  int unit, pend;
+  int unit, pend, jump;
 
   // median filtering
   unsigned char med[10000];
   int vals[256], lowest[6];
  
   // temporal smoothing
-  unsigned char avg[10000], var[10000];
+  unsigned char avg[10000], var[10000], age[10000];
   int frame;
+
+  // depth rate for time-to-contact
+  int rate[10000];
  
   // resolution scaling
   unsigned short norm[9][256];
 
-  // final 16 bit depth images
-  unsigned char d0[20000], d1[20000], d2[20000];
-  unsigned char *fill, *done, *lock;
-  int fresh;
+  // pool of 16 bit depth images with matching contact maps and information
+  unsigned char dimg[9][20000];
+  unsigned short tmap[9][10000];
+  jhcTofMeta info[9];
+  unsigned char *fill;
+  jhcTofMeta *mfill;
+  int ifill, stale;
+
+  // subscribers (0 is default) with pending and locked pool images
+  long long snext[4];
+  float sfps[4];
+  int sout[4], son[4], sdue[4], sev[4], snew[4], slock[4];
+  int cwant;
+
+  // change-only event lists (3 per subscriber) and last sent values
+  unsigned short elist[4][3][15004];
+  unsigned short eref[4][10000], bval[625];
+  unsigned char emark[10000];
+  int bsum[625], bcnt[625];
+  int elen[4][3], efill[4], epend[4], ehold[4], ecnt[4], emode[4];
+  int en[4], ehd[4], elast[4];
+
+  // precise static capture
+  unsigned char *chist;
+  unsigned short cdep[10000], cdev[10000];
+  int cstate, cn, ctrim, ci, cunit;
 
   // debugging 8 bit depth image
   unsigned char nite[10000];
@@ -72,12 +140,26 @@ private:
 
 // PUBLIC MEMBER VARIABLES
 public:
+  // serial input parameters
+  int uring;
+
   // auto-ranging parameters
   int sat, pct, ihi, cx0, cy0, cw, ch; 
 
   // temporal smoothing parameters
   float f0, nv, vlim;
 
+  // saturated pixel recovery parameters
+  int hold, vh;
+
+  // time-to-contact parameters
+  int fr, tx0, ty0, tw, th;
+  float tmax;
+
+  // change event parameters
+  int eblk, ekey;
+  float etol;
+
 
 // PUBLIC MEMBER FUNCTIONS
 public:
@@ -87,9 +169,39 @@ public:
 
   // main functions
   int Start (int port =0);
-  const unsigned char *Range (int block =0);
+  const unsigned char *Range (int block =0, int sub =0);
   void Done ();
 
+  // subscriptions (outs: 1 = time-to-contact, 2 = change events)
+  int Subscribe (float fps =0.0f, int outs =3, int sub =-1);
+  void Unsubscribe (int sub);
+  int Subscribed (int sub) const {return(((sub >= 0) && (sub < 4)) ? son[sub] : 0);}
+
+  // raw byte stream recording
+  int Replay (const char *fname);
+  int Record (const char *fname);
+  const jhcTofTee& Recorder () const {return tee;}
+
+  // frame information (sync'd with Range for subscriber)
+  long long Stamp (int sub =0) const {return((Info(sub) != NULL) ? Info(sub)->tstamp : 0);}
+  float StampErr (int sub =0) const {return((Info(sub) != NULL) ? Info(sub)->terr : -1.0f);}
+  int FrameID (int sub =0) const {return((Info(sub) != NULL) ? Info(sub)->fid : -1);}
+  float Period () const {return((float) clk.Period());}
+  const jhcTofMeta *Info (int sub =0) const 
+    {return((((sub >= 0) && (sub < 4)) && (slock[sub] >= 0)) ? info + slock[sub] : NULL);}
+  const unsigned char *Last (int sub =0) const 
+    {return((((sub >= 0) && (sub < 4)) && (slock[sub] >= 0)) ? dimg[slock[sub]] : NULL);}
+  const unsigned char *Contact (int sub =0) const;
+  const unsigned short *Events (int& n, int sub =0) const;
+
+  // precise static capture
+  int Precise (int n, int trim =10, int block =1);
+  int PreciseReady ();
+  const unsigned char *PreciseDepth () 
+    {return((PreciseReady() > 0) ? (const unsigned char *) cdep : NULL);}
+  const unsigned char *PreciseDev () 
+    {return((PreciseReady() > 0) ? (const unsigned char *) cdev : NULL);}
+
   // debugging functions (not sync'd with background)
   int Step () const {return unit;}
   const unsigned char *Sensor () const {return raw;}
@@ -104,23 +216,39 @@ private:
   void build_lut ();
 
   // main functions
-  int open_usb ();
+  int launch ();
+  int open_usb (int port);
   void pwr_cycle () const;
 
   // background thread functions
   static void *absorb (void *tof);
   int sync ();
   int fill_raw ();
+  int rx_byte ();
+  int rx_fill ();
+  void time_frame ();
+  void pace (int id);
+  void schedule ();
   void swap_bufs ();
 
   // image filtering
+  void pad_raw ();
   void median5x5 ();
   void flywheel ();
+  void contact (const unsigned short *c);
   void reformat ();
+  void ev_cell (int s, const unsigned short *g, int i, int val, int tol, int force);
+  void ev_merge (int s);
 
   // range adjustment
+  void hist_pcts (float *p, const int *h) const;
   void auto_range ();
   void depth_step ();
 
+  // precise static capture
+  void cap_frame ();
+  void cap_bin (const unsigned char *src);
+  void cap_finish ();
+
 };
 
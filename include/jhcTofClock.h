@@ -0,0 +1,65 @@
+// jhcTofClock.h : estimates true sensor frame times from jittery arrivals
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+//= Estimates true sensor frame times from jittery arrivals.
+// fits arrival = offset + period * frame_id by weighted least squares
+// old observations fade geometrically so slow clock drift is tracked
+// sums are kept relative to newest sample to preserve precision
+
+class jhcTofClock
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // weighted regression sums (relative to newest sample)
+  double sw, sn, st, snn, snt, stt;
+
+  // reference sample and frame id unwrapping
+  long long t0;
+  int last, cnt;
+
+  // most recent estimates
+  double per, err;
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // filter parameters
+  float fade, rst;
+  int fmax;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofClock ();
+  void Reset ();
+
+  // main functions
+  long long Update (long long arrive, int id);
+  double Period () const {return per;}
+  double Error () const {return err;}
+  int Count () const {return cnt;}
+
+};
@@ -0,0 +1,102 @@
+// jhcTofCloud.h : converts TOF depth image into organized 3D point cloud
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+//= Converts TOF depth image into organized 3D point cloud.
+// pixel i is at column (i % 100) and row (i / 100) of Range image
+// camera frame: x along columns, y along rows, z out along optic axis
+// world frame: X to right, Y forward, Z up (camera at cx, cy, cz)
+// zero pan, tilt, and roll means camera x = X, y = -Z, and z = Y
+// all coordinates in mm, invalid points have z = 0 (and all 3 zero)
+// also builds depth pyramid of valid averages (100, 50, 25, 13 pixels)
+
+class jhcTofCloud
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // ray lookup table (x/z and y/z for each pixel)
+  float rx[10000], ry[10000];
+  float f0, a0;
+
+  // camera to world transform
+  float rot[9];
+
+  // organized clouds and depth pyramid
+  float xyz[30000], wxyz[30000];
+  unsigned short pyr[13294];
+  int nv;
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // camera intrinsics (focal length along rows in pixels)
+  float flen, asp;
+
+  // camera extrinsics (mm and degrees)
+  float cx, cy, cz, pan, tilt, roll;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofCloud ();
+
+  // main functions
+  int Convert (const unsigned char *range);
+  void ToWorld (float& wx, float& wy, float& wz, float x, float y, float z) const;
+  void ToCam (float& x, float& y, float& z, float wx, float wy, float wz) const;
+
+  // read-only access
+  const float *Cam () const {return xyz;}
+  const float *World () const {return wxyz;}
+  const unsigned short *Depth (int lvl =0) const {return(pyr + LvlOff(lvl));}
+  int Valid () const {return nv;}
+  float RayX (int i) const {return rx[i];}
+  float RayY (int i) const {return ry[i];}
+  const float *Rot () const {return rot;}
+
+  // pose geometry
+  static void PoseRot (float *r, float p, float t, float rl);
+
+  // pyramid geometry
+  static int LvlSide (int lvl) {return((lvl <= 0) ? 100 : ((lvl == 1) ? 50 : ((lvl == 2) ? 25 : 13)));}
+  static int LvlOff (int lvl) {return((lvl <= 0) ? 0 : ((lvl == 1) ? 10000 : ((lvl == 2) ? 12500 : 13125)));}
+  static int Levels () {return 4;}
+  static int PyrSize () {return 13294;}
+
+  // plane fitting
+  static void AddMoments (double *m, const float *p);
+  static float FitPlane (float *n, float& d, const double *m);
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  // creation and initialization
+  void build_rays ();
+  void build_rot ();
+
+  // main functions
+  void shrink (int lvl);
+
+};
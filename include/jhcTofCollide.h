@@ -0,0 +1,87 @@
+// jhcTofCollide.h : conservative sphere and capsule checks against depth image
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <jhcTofCloud.h>
+
+
+//= Conservative sphere and capsule checks against depth image.
+// Pin copies a depth image and camera model, then builds a min pyramid
+// a sphere is free only if every pixel it could cover sees a surface
+// beyond its far side (plus margin), otherwise it is reported as a hit
+// image footprint of sphere comes from exact tangent rays in x and y
+// pyramid is searched coarse to fine so most queries touch few cells
+// capsules are covered by a chain of slightly larger spheres
+// queries only read pinned data so many threads can run them at once
+// but Pin must not be called while any queries are in progress
+
+class jhcTofCollide
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // pinned min pyramid (0.25mm units, 100 50 25 13 7 4 2 1 pixels)
+  unsigned short mpyr[13364];
+  int ok;
+
+  // pinned camera model
+  float sx, sy, rot[9], pos[3];
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // extra clearance required (mm)
+  float margin;
+
+  // treat invalid pixels and out of view as occupied
+  int unk;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofCollide ();
+
+  // main functions
+  int Pin (const unsigned char *range, const jhcTofCloud& cloud);
+  int Sphere (float x, float y, float z, float r, int world =0) const;
+  int Spheres (unsigned char *hit, const float *xyzr, int n, int world =0) const;
+  int Capsules (unsigned char *hit, const float *abr, int n, int world =0) const;
+
+  // read-only access
+  int Pinned () const {return ok;}
+  const unsigned short *MinDepth (int lvl =0) const {return(mpyr + LvlOff(lvl));}
+
+  // pyramid geometry
+  static int LvlSide (int lvl) {return((lvl <= 0) ? 100 : (((LvlSide(lvl - 1)) + 1) >> 1));}
+  static int LvlOff (int lvl) {return((lvl <= 0) ? 0 : LvlOff(lvl - 1) + LvlSide(lvl - 1) * LvlSide(lvl - 1));}
+  static int Levels () {return 8;}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  void shrink (int lvl);
+  int cam_sphere (const float *c, float r) const;
+  int tangents (float& lo, float& hi, float a, float z, float r) const;
+  int occupied (int lvl, int x0, int x1, int y0, int y1, int lim) const;
+
+};
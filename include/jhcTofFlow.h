@@ -0,0 +1,86 @@
+// jhcTofFlow.h : dense 3D scene flow between consecutive TOF frames
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <jhcTofCloud.h>
+
+
+//= Dense 3D scene flow between consecutive TOF frames.
+// coarse-to-fine 3x3 block matching over depth pyramid from jhcTofCloud
+// matches depth shape (offset removed) so approaching surfaces still align
+// featureless blocks (e.g. planes) copy motion of neighbors on same surface
+// all matching in integer 0.25mm depth units, only final vectors use rays
+// flow for pixel i of previous frame is 3 shorts (mm) in camera frame
+
+class jhcTofFlow
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // previous depth pyramid
+  unsigned short last[13294];
+  int nf;
+
+  // pixel displacements and confidence at current and coarser level
+  short du[10000], dv[10000], cu[10000], cv[10000];
+  unsigned char hit[10000], chit[10000], amb[10000], camb[10000];
+  short fit[10000], spr[10000];
+  int inv[10];
+
+  // final 3D vectors
+  short fxyz[30000];
+  int nm;
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // matching parameters
+  int dmax, sm, zm, tex, ds;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofFlow ();
+  void Reset () {nf = 0;}
+
+  // main functions
+  int Analyze (const jhcTofCloud& now);
+
+  // read-only access
+  const short *Flow () const {return fxyz;}
+  const unsigned char *Mask () const {return hit;}
+  int Count () const {return nm;}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  void match_lvl (int lvl, const unsigned short *d1, int rng);
+  int parent (const unsigned short *ca, int cw, int x, int y, int d) const;
+  int block_cost (int& m, const unsigned short *a, const unsigned short *b, 
+                  int w, int x, int y, int u, int v) const;
+  int behind (const unsigned short *a, int w, int x, int y, int tol) const;
+  void propagate ();
+  int nbr_avg (int p, int w, int tol, const unsigned short *a);
+  void vectors (const jhcTofCloud& now);
+
+};
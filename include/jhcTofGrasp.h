@@ -0,0 +1,90 @@
+// jhcTofGrasp.h : proposes top-down grasps for objects found on support plane
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stddef.h>
+
+#include <jhcTofCloud.h>
+#include <jhcTofObjs.h>
+
+
+//= Proposes top-down grasps for objects found on support plane.
+// uses labels, heights, and plane from a previous jhcTofObjs analysis
+// footprint of each object is projected onto plane to find principal axes
+// gripper approaches along plane normal and closes across either axis
+// grasp point is centroid of footprint at mean height of top surface
+// clearance is free space beyond each finger before some other tall pixel
+// all points and directions are in camera frame (mm)
+
+class jhcTofGrasp
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // plane coordinate system and approach direction
+  float ux[3], vx[3], nx[3], ax[3], d0;
+
+  // object footprint statistics (plane coordinates)
+  float ctr[100][2], maj[100][2], size[100][2], top[100];
+  int box[100][4];
+
+  // grasp candidates
+  float gpos[200][3], gdir[200][3], gwid[200], gclr[200];
+  int gobj[200], ng;
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // gripper geometry (mm)
+  float open, fthick, fwid, margin;
+
+  // fraction of max height counted as top surface
+  float tfrac;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofGrasp ();
+
+  // main functions
+  int Analyze (const jhcTofObjs& objs, const jhcTofCloud& cloud);
+
+  // grasp properties (object number, point, closing direction, width, clearance)
+  int Count () const {return ng;}
+  int Object (int i) const {return(((i >= 1) && (i <= ng)) ? gobj[i - 1] : 0);}
+  const float *Point (int i) const {return(((i >= 1) && (i <= ng)) ? gpos[i - 1] : NULL);}
+  const float *Closing (int i) const {return(((i >= 1) && (i <= ng)) ? gdir[i - 1] : NULL);}
+  float Width (int i) const {return(((i >= 1) && (i <= ng)) ? gwid[i - 1] : 0.0f);}
+  float Clearance (int i) const {return(((i >= 1) && (i <= ng)) ? gclr[i - 1] : 0.0f);}
+  const float *Approach () const {return ax;}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  void plane_axes (const jhcTofObjs& objs);
+  void footprints (const jhcTofObjs& objs, const jhcTofCloud& cloud);
+  void add_grasp (int k, int across, const jhcTofObjs& objs, const jhcTofCloud& cloud);
+  float clearance (const float *g, const float *c, float w, int k,
+                   const jhcTofObjs& objs, const jhcTofCloud& cloud) const;
+
+};
@@ -0,0 +1,90 @@
+// jhcTofGrid.h : overhead height map and obstacle distance grid
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <jhcTofCloud.h>
+
+
+//= Overhead height map and obstacle distance grid.
+// grid is 128 x 128 cells centered left-right on point below camera
+// column c is at X = cx + (c - 63.5) * cell, row r at Y = cy + (127.5 - r) * cell
+// so row 0 is farthest forward and bottom row is right in front of robot
+// height map holds tallest world Z (mm) seen in each cell this frame
+// obstacle cells have some point between hobs and hmax above floor
+// optional exact Euclidean distance transform (Felzenszwalb-Huttenlocher)
+// distances are capped at dmax so only cells near changes are recomputed
+// call Reset after changing cell size or dmax to redo whole grid
+
+class jhcTofGrid
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // height map and obstacles
+  short hmap[16384];
+  unsigned char occ[16384], occ0[16384];
+  int nobs;
+
+  // distance map and intermediate squared distances
+  float dist[16384], col[16384];
+  int valid;
+
+  // 1D transform workspace
+  float f[128], d[128], z[129];
+  int v[128];
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // cell size and height limits (mm)
+  float cell, hobs, hmax;
+
+  // distance transform (enable and cap in mm)
+  int dt;
+  float dmax;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofGrid ();
+  void Reset () {valid = 0;}
+
+  // main functions
+  int Build (const jhcTofCloud& cloud);
+
+  // read-only access
+  static int Side () {return 128;}
+  int Obstacles () const {return nobs;}
+  const short *Height () const {return hmap;}
+  const unsigned char *Occupied () const {return occ;}
+  const float *Dist () const {return dist;}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  void height_map (const jhcTofCloud& cloud);
+  int changes (int *box) const;
+  void update_dt (const int *box);
+  void edt_1d (int n);
+
+};
@@ -0,0 +1,83 @@
+// jhcTofHash.h : spatial hash of cloud points for neighborhood queries
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <jhcTofCloud.h>
+
+
+//= Spatial hash of cloud points for neighborhood queries.
+// each valid point goes in a bucket based on the cubic cell it falls in
+// buckets hold doubly linked lists of pixels so points can be moved cheaply
+// on each Build only pixels whose coordinates changed are examined and
+// a pixel is relinked only if it moved to a different cell
+// cells that collide in the hash share a bucket but are told apart by
+// the cell coordinates saved for each point
+// call Reset after changing cell size or to force a full rebuild
+
+class jhcTofHash
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // bucket list heads and per-pixel links
+  int head[8192], nxt[10000], prv[10000];
+
+  // indexed points and their cells (ix, iy, iz)
+  float pts[30000];
+  int cell[30000];
+  unsigned char in[10000];
+  int npts, moved, frame, valid;
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // size of cubic cell (mm)
+  float sz;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofHash ();
+  void Reset () {valid = 0;}
+
+  // main functions
+  int Build (const jhcTofCloud& cloud, int world =0);
+  int Radius (int *ids, int most, float x, float y, float z, float r) const;
+  int Nearest (int *ids, float *dist, int k, float x, float y, float z, float rmax) const;
+
+  // read-only access
+  int Count () const {return npts;}
+  int Moved () const {return moved;}
+  int World () const {return frame;}
+  const float *Points () const {return pts;}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  void clear ();
+  void link (int i);
+  void unlink (int i);
+  int bucket (int ix, int iy, int iz) const;
+  int keep (int *ids, float *d2, int n, int k, int i, float v) const;
+
+};
@@ -0,0 +1,128 @@
+// jhcTofIcp.h : known object pose tracking by template ICP
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <pthread.h>
+
+#include <jhcTofCloud.h>
+
+
+//= Known object pose tracking by template ICP.
+// each of several slots holds a template point set with normals in its own
+// frame along with its current pose in camera frame (p = R m + t)
+// template normals come from caller or mesh triangles (e.g. jhcTofMesh PLY)
+// every Update refines each pose by point-to-plane ICP starting from the
+// last one, where correspondences are found by projecting template points
+// into the organized cloud (no search) and scene normals come from pixel
+// neighbors, so template points facing away from camera are skipped
+// optional mask (e.g. jhcTofObjs labels) limits matches to object pixels
+// slots are solved in parallel threads since they share only the cloud
+// fitness is fraction of visible template points with a close match
+// lost templates keep trying from their last pose in later frames
+
+class jhcTofIcp
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // templates (model frame points and unit normals)
+  float mpt[8][6000], mnv[8][6000], mc[8][3], mrad[8];
+  int nm[8], has_nv[8];
+
+  // pose and quality for each slot
+  double rot[8][9], pos[8][3];
+  float fit[8], err[8];
+  int stat[8], used[8], its[8];
+
+  // scene normals for current cloud
+  float snv[30000];
+
+  // shared inputs during Update
+  const jhcTofCloud *src;
+  const unsigned short *msk;
+  float sx, sy;
+
+  // thread arguments (object and slot)
+  struct icp_job {jhcTofIcp *me; int slot;} job[8];
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // iteration control (max passes, rotation and shift change in rad and mm)
+  int iter;
+  float drot, dpos;
+
+  // matching (max distance in mm, max normal angle in degrees, min matches)
+  float dmax, ang;
+  int nmin;
+
+  // residual where Cauchy weight drops to half (mm)
+  float rob;
+
+  // scene normal estimation (pixel offset, max depth jump fraction)
+  int nstep;
+  float jump;
+
+  // run slots in separate threads
+  int par;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofIcp ();
+  static int Slots () {return 8;}
+  static int MaxPts () {return 2000;}
+  int SetModel (int i, const float *pts, const float *nv, int n);
+  int SetMesh (int i, const float *verts, int nv, const int *tris, int nt);
+  int LoadPly (int i, const char *fname);
+  int SetPose (int i, const float *r, const float *t);
+  void Drop (int i);
+
+  // main functions
+  int Update (const jhcTofCloud& cloud, const unsigned short *mask =NULL);
+
+  // read-only access (status: 0 = empty, 1 = lost, 2 = tracking)
+  int Status (int i) const {return(((i >= 0) && (i < 8)) ? stat[i] : 0);}
+  int Pose (int i, float *r, float *t) const;
+  float Fitness (int i) const {return(((i >= 0) && (i < 8)) ? fit[i] : 0.0f);}
+  float Rms (int i) const {return(((i >= 0) && (i < 8)) ? err[i] : 0.0f);}
+  int Matches (int i) const {return(((i >= 0) && (i < 8)) ? used[i] : 0);}
+  int Iterations (int i) const {return(((i >= 0) && (i < 8)) ? its[i] : 0);}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  // scene normals
+  void footprint (int *box, int i) const;
+  void scene_normals (const float *pts, const int *box);
+  int tangent (float *t, const float *p, const float *lo, const float *hi) const;
+
+  // registration
+  static void *solver (void *arg);
+  void track (int i);
+  int step (double *x, double& rms, int& vis, int i) const;
+  int solve6 (double *x, double *a, double *b) const;
+  void center (double *c, int i) const;
+  void apply (int i, const double *x);
+
+};
@@ -0,0 +1,93 @@
+// jhcTofLevel.h : tracks camera tilt, roll, and height from floor over time
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <jhcTofCloud.h>
+
+
+//= Tracks camera tilt, roll, and height from floor over time.
+// floor is found in each frame on a coarse grid of pixels by fitting points
+// in a wide band around current estimate then refitting a narrow band
+// narrow band moments are added to exponentially decaying sums (recursive least
+// squares with forgetting) and plane is refit from these every frame
+// a frame whose own floor fit disagrees a lot restarts the sums (a bump)
+// too few floor points for several frames means tracking is lost
+// pan and floor position are not observable so they are left alone
+
+class jhcTofLevel
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // decaying moment sums (count, x, y, z, xx, xy, xz, yy, yz, zz)
+  double acc[10];
+
+  // tracked floor plane in camera frame (n . p + d = 0, d > 0)
+  float pn[3], pd;
+  int seeded, miss, chg, jumps;
+
+  // derived camera pose (degrees and mm)
+  float t0, r0, h0;
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // sampling and floor bands (pixels and mm)
+  int step;
+  float ptol, pwide;
+
+  // memory and evidence (decay per frame, min points, max bad frames)
+  float decay;
+  int nmin, lost;
+
+  // change needed to declare a bump (degrees and mm)
+  float dang, dhgt;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofLevel ();
+  void Reset () {seeded = 0;}
+  int Seed (const float *n, float d);
+  int Seed (const jhcTofCloud& cloud);
+
+  // main functions
+  int Update (jhcTofCloud& cloud, int fix =1);
+
+  // read-only access
+  int Tracking () const {return seeded;}
+  int Changed () const {return chg;}
+  int Jumps () const {return jumps;}
+  float Tilt () const {return t0;}
+  float Roll () const {return r0;}
+  float Height () const {return h0;}
+  const float *Normal () const {return pn;}
+  float Offset () const {return pd;}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  int floor_pts (double *m, const float *pts, const float *n, float d, float tol) const;
+  void pose ();
+
+};
@@ -0,0 +1,76 @@
+// jhcTofMesh.h : triangulates organized TOF point cloud into surface mesh
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <jhcTofCloud.h>
+
+
+//= Triangulates organized TOF point cloud into surface mesh.
+// each 2x2 pixel cell gives up to 2 triangles (split on shorter diagonal)
+// edges spanning a depth discontinuity are not connected
+// vertices are only the valid points used by some triangle (mm)
+// triangles are 3 vertex indices, counter-clockwise seen from camera
+
+class jhcTofMesh
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // vertex index for each pixel (-1 = unused)
+  int vidx[10000];
+
+  // indexed mesh
+  float vert[30000];
+  int tri[58806];
+  int nv, nt;
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // depth discontinuity test (mm and fraction of depth)
+  float dabs, frac;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofMesh ();
+
+  // main functions
+  int Build (const jhcTofCloud& cloud, int world =0);
+  int SavePly (const char *fname) const;
+
+  // read-only access
+  int Verts () const {return nv;}
+  int Tris () const {return nt;}
+  const float *Vertex () const {return vert;}
+  const int *Triangle () const {return tri;}
+  const int *Pixel2Vert () const {return vidx;}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  int joined (float za, float zb) const;
+  void add_tri (int a, int b, int c, const float *cam, const float *pts);
+  int get_vert (int i, const float *pts);
+
+};
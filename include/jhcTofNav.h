@@ -0,0 +1,74 @@
+// jhcTofNav.h : finds how far floor is clear in each direction for navigation
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <jhcTofCloud.h>
+
+
+//= Finds how far floor is clear in each direction for navigation.
+// needs camera pose in jhcTofCloud so that world Z is height above floor
+// each image column is scanned upward from bottom row (nearest floor)
+// free distance is ground range of farthest floor pixel before a blockage
+// blockage is an obstacle, a drop, or a long run of invalid pixels
+// ranges are measured horizontally from point on floor below camera
+// bearings are in degrees with positive to right of world Y axis
+
+class jhcTofNav
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // per column results
+  float fdist[100], odist[100], bear[100];
+  int why[100];
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // height limits (mm)
+  float hobs, hmax, drop;
+
+  // max invalid pixels between floor points
+  int gap;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofNav ();
+
+  // main functions
+  int Analyze (const jhcTofCloud& cloud);
+  float Corridor (float lf, float rt) const;
+
+  // read-only access (free and obstacle range, bearing, reason for stop)
+  const float *Free () const {return fdist;}
+  const float *Blocked () const {return odist;}
+  const float *Bearing () const {return bear;}
+  const int *Reason () const {return why;}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  void scan_col (const jhcTofCloud& cloud, int x);
+
+};
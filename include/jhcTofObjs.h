@@ -0,0 +1,112 @@
+// jhcTofObjs.h : finds objects above support plane and measures their size
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <jhcTofCloud.h>
+
+
+//= Finds objects above support plane and measures their size.
+// plane is dominant one in camera frame cloud (RANSAC then least squares)
+// height image is mm above plane, objects are connected blobs of height
+// each pixel covers ground area z^2 / (fx * fy * |ray . n|) on plane
+// volume integrates height over this area, so assumes objects are solid
+// object labels are 1 to Count() in label image (0 = background)
+
+class jhcTofObjs
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // plane samples and random state
+  int samp[10000];
+  unsigned int seed;
+
+  // support plane (camera frame): n . p + d = height
+  float pn[3], pd;
+  int pok;
+
+  // height and label images
+  short hgt[10000];
+  unsigned short lab[10000], par[10001];
+
+  // object properties
+  float vol[100], area[100], tall[100];
+  int npix[100], nobj;
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // plane fitting parameters
+  int iter, step;
+  float ptol;
+
+  // object finding parameters
+  float hmin, dstep;
+  int amin;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofObjs ();
+
+  // main functions
+  int Analyze (const jhcTofCloud& cloud);
+  int FitPlane (const jhcTofCloud& cloud);
+
+  // support plane
+  int Plane () const {return pok;}
+  const float *Normal () const {return pn;}
+  float Offset () const {return pd;}
+
+  // object properties (mm, mm^2, mm^3)
+  int Count () const {return nobj;}
+  float Volume (int i) const {return(((i >= 1) && (i <= nobj)) ? vol[i - 1] : 0.0f);}
+  float Footprint (int i) const {return(((i >= 1) && (i <= nobj)) ? area[i - 1] : 0.0f);}
+  float MaxHt (int i) const {return(((i >= 1) && (i <= nobj)) ? tall[i - 1] : 0.0f);}
+  int Pixels (int i) const {return(((i >= 1) && (i <= nobj)) ? npix[i - 1] : 0);}
+
+  // read-only images
+  const short *Height () const {return hgt;}
+  const unsigned short *Labels () const {return lab;}
+
+  // footprint geometry (plane coordinates)
+  void PlaneAxes (float *u, float *v) const;
+  void Extents (float (*ctr)[2], float (*dir)[2], float (*size)[2],
+                const float *u, const float *v, const jhcTofCloud& cloud) const;
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  // plane fitting
+  int plane_3pt (float *n, float& d, const float *pts, int a, int b, int c) const;
+  int inliers (const float *n, float d, const float *pts, int ns) const;
+  int refine (const float *pts);
+  unsigned int rnd ();
+
+  // object finding
+  void heights (const float *pts);
+  int components (const unsigned short *dep);
+  int root (int i);
+  void measure (const jhcTofCloud& cloud);
+
+};
@@ -0,0 +1,102 @@
+// jhcTofPlanes.h : finds all large planar surfaces in TOF point cloud
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <jhcTofCloud.h>
+
+
+//= Finds all large planar surfaces in TOF point cloud.
+// image is cut into 20 x 20 grid of 5 x 5 pixel blocks, each fit by a plane
+// flat blocks are grown into regions with similar normals (best blocks first)
+// region boundaries are then refined by assigning pixels to closest plane
+// planes in camera frame: n . p + d = 0 with camera on positive side (d > 0)
+// plane labels are 1 to Count() in label image (0 = not on any plane)
+
+class jhcTofPlanes
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // block statistics (count, x, y, z, xx, xy, xz, yy, yz, zz)
+  double bsum[400][10];
+  float bn[400][3], bd[400], brms[400];
+  int order[400], queue[400], blab[400], nblk;
+
+  // region statistics during growing
+  double rsum[10];
+  float rn[3], rd;
+
+  // plane properties
+  float pn[50][3], pd[50], prms[50];
+  int npix[50], np;
+
+  // pixel labels
+  unsigned short lab[10000];
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // block flatness (max depth step and rms deviation)
+  float dabs, dfrac, eabs, efrac;
+
+  // region growing (max degrees between normals, min blocks)
+  float ang;
+  int bmin;
+
+  // pixel assignment (max distance from plane)
+  float pabs, pfrac;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofPlanes ();
+
+  // main functions
+  int Analyze (const jhcTofCloud& cloud);
+
+  // plane properties (unit normal, offset and rms in mm)
+  int Count () const {return np;}
+  const float *Normal (int i) const {return(((i >= 1) && (i <= np)) ? pn[i - 1] : NULL);}
+  float Offset (int i) const {return(((i >= 1) && (i <= np)) ? pd[i - 1] : 0.0f);}
+  float Rms (int i) const {return(((i >= 1) && (i <= np)) ? prms[i - 1] : 0.0f);}
+  int Pixels (int i) const {return(((i >= 1) && (i <= np)) ? npix[i - 1] : 0);}
+
+  // read-only images
+  const unsigned short *Labels () const {return lab;}
+  int Blocks () const {return nblk;}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  // main functions
+  void fit_blocks (const float *pts);
+  int block_ok (const float *pts, int bx, int by) const;
+  int grow_regions ();
+  int grow (int seed, int n);
+  void assign_pixels (const float *pts);
+  void refit_planes (const float *pts);
+
+  // plane fitting
+  float tol (float z, float a, float f) const {return(a + f * z);}
+
+};
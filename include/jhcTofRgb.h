@@ -0,0 +1,95 @@
+// jhcTofRgb.h : registers depth image into an external RGB camera
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <jhcTofCloud.h>
+
+
+//= Registers depth image into an external RGB camera.
+// output is depth along RGB camera axis (0.25mm, 65535 = unknown) at RGB size
+// each 2x2 block of depth pixels forms two triangles which are projected
+// into the RGB image and filled with perspective correct depth, keeping
+// the closest surface where several overlap (z-buffer)
+// triangles spanning a big depth jump are skipped so occlusion edges
+// and missing data show up as unknown instead of being smeared
+// rotated depth rays are precomputed so each pixel needs only a scale,
+// shift, and divide (plus optional radial distortion)
+// call Reset after changing any camera parameter to rebuild lookup table
+
+class jhcTofRgb
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // depth rays rotated into RGB frame
+  float dir[30000];
+  int ready;
+
+  // projected depth pixels (RGB column, row, and 1 / depth)
+  float pu[10000], pv[10000], iz[10000];
+  unsigned char ok[10000];
+
+  // output image
+  unsigned short *zbuf;
+  int w, h, nz;
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // RGB camera image size and intrinsics (pixels)
+  int rw, rh;
+  float fx, fy, ppx, ppy, k1, k2;
+
+  // RGB camera pose relative to depth camera (p_rgb = rot * p_tof + shift)
+  float rot[9], shift[3];
+
+  // depth camera intrinsics (as in jhcTofCloud)
+  float flen, asp;
+
+  // max depth difference within a triangle (fraction of depth)
+  float jump;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  ~jhcTofRgb ();
+  jhcTofRgb ();
+  void Reset () {ready = 0;}
+
+  // main functions
+  int Register (const unsigned char *range);
+
+  // read-only access
+  const unsigned short *Depth () const {return zbuf;}
+  int Width () const {return w;}
+  int Height () const {return h;}
+  int Filled () const {return nz;}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  int build_lut ();
+  void project (const unsigned short *d);
+  void tri (int a, int b, int c);
+
+};
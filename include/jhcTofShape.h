@@ -0,0 +1,99 @@
+// jhcTofShape.h : fits box and cylinder primitives to objects on support plane
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stddef.h>
+
+#include <jhcTofCloud.h>
+#include <jhcTofObjs.h>
+
+
+//= Fits box and cylinder primitives to objects on support plane.
+// uses labels, heights, and plane from a previous jhcTofObjs analysis
+// both shapes stand upright on plane and are fit in plane coordinates
+// box: yaw from footprint principal axis, then least squares face offsets
+// cylinder: least squares circle through rim and side points (Kasa method)
+// height for both is mean height of top surface points
+// residual is rms distance of object points from primitive surface
+// centers are middle of base on plane, all in camera frame (mm)
+
+class jhcTofShape
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // plane coordinate system
+  float ux[3], vx[3], nx[3], d0;
+
+  // box fits (plane coordinates, half sizes, and residual)
+  float ba[100], bb[100], bdir[100][2], bhalf[100][2], bht[100], berr[100];
+
+  // cylinder fits (plane coordinates and residual)
+  float ca[100], cb[100], crad[100], cerr[100];
+
+  // results in camera frame
+  float ctr[100][3], ax[100][3], dims[100][3];
+  int kind[100], nobj;
+
+
+// PUBLIC MEMBER VARIABLES
+public:
+  // fraction of max height counted as top surface
+  float tfrac;
+
+  // preference for box when residuals are similar
+  float bias;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  jhcTofShape ();
+
+  // main functions
+  int Analyze (const jhcTofObjs& objs, const jhcTofCloud& cloud);
+
+  // best primitive for object (1 = box, 2 = cylinder)
+  int Count () const {return nobj;}
+  int Kind (int i) const {return(((i >= 1) && (i <= nobj)) ? kind[i - 1] : 0);}
+  const float *Center (int i) const {return(((i >= 1) && (i <= nobj)) ? ctr[i - 1] : NULL);}
+  const float *Axis (int i) const {return(((i >= 1) && (i <= nobj)) ? ax[i - 1] : NULL);}
+  const float *Dims (int i) const {return(((i >= 1) && (i <= nobj)) ? dims[i - 1] : NULL);}
+
+  // fit residuals (rms mm)
+  float BoxErr (int i) const {return(((i >= 1) && (i <= nobj)) ? berr[i - 1] : 0.0f);}
+  float CylErr (int i) const {return(((i >= 1) && (i <= nobj)) ? cerr[i - 1] : 0.0f);}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  void plane_axes (const jhcTofObjs& objs);
+  void moments (const jhcTofObjs& objs, const jhcTofCloud& cloud);
+  void box_extents (const jhcTofObjs& objs, const jhcTofCloud& cloud);
+  void box_faces (const jhcTofObjs& objs, const jhcTofCloud& cloud);
+  void residuals (const jhcTofObjs& objs, const jhcTofCloud& cloud);
+  void results (int k);
+  void box_local (float& s1, float& s2, int k, float a, float b) const;
+  float box_dist (float s1, float s2, float h, int k) const;
+  float cyl_dist (float a, float b, float h, int k) const;
+
+};
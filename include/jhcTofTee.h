@@ -0,0 +1,78 @@
+// jhcTofTee.h : records exact received serial byte stream to a file
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <pthread.h>
+
+
+//= Records exact received serial byte stream to a file.
+// acquisition thread only copies chunks into a lock-free ring
+// separate writer thread drains ring in large aligned blocks
+// tries O_DIRECT so recording bypasses page cache (if file system allows)
+// never blocks caller: recording stops for good if ring ever overflows
+// so file is a gap-free prefix of stream (later bytes counted as dropped)
+
+class jhcTofTee
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // output file and writer thread
+  pthread_t scribe;
+  int file, run;
+
+  // ring buffer (head written by Add, tail by writer)
+  unsigned char *ring;
+  long long head, tail;
+  int rsz, blk;
+
+  // statistics
+  long long drop, cost;
+  int calls, over;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  ~jhcTofTee ();
+  jhcTofTee ();
+
+  // main functions
+  int Open (const char *fname, int mb =1, int kb =64);
+  void Add (const unsigned char *src, int n);
+  void Close ();
+  int Active () const {return((file >= 0) ? 1 : 0);}
+
+  // overhead statistics
+  long long Bytes () const {return head;}
+  long long Dropped () const {return drop;}
+  int Overflow () const {return over;}
+  double Cost () const {return((calls > 0) ? cost / (double) calls : 0.0);}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  // background thread functions
+  static void *drain (void *tee);
+  int flush (int all);
+
+};
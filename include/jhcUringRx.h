@@ -0,0 +1,76 @@
+// jhcUringRx.h : serial byte receiver using Linux io_uring with fixed buffers
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+
+//= Serial byte receiver using Linux io_uring with fixed buffers.
+// packet buffers come from a pool registered once with the kernel
+// next read is always posted before previous chunk is handed out
+// only one read in flight so byte order of stream is preserved
+// without polling each chunk still costs a syscall to post next read
+// (and another to wait if current read has not finished yet)
+// optional kernel polling thread means submissions need no syscalls
+// Open fails cleanly if io_uring is missing (caller uses read instead)
+
+class jhcUringRx
+{
+// PRIVATE MEMBER VARIABLES
+private:
+  // ring file and mapped regions
+  int ring, poll;
+  void *sq_map, *cq_map, *sqe_map;
+  unsigned sq_sz, cq_sz, sqe_sz;
+
+  // submission queue pointers
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_flags, *sq_array;
+
+  // completion queue pointers
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  void *cqes;
+
+  // registered buffer pool
+  unsigned char *pool;
+  int nb, bsz, post;
+
+
+// PUBLIC MEMBER FUNCTIONS
+public:
+  // creation and initialization
+  ~jhcUringRx ();
+  jhcUringRx ();
+
+  // main functions
+  int Open (int fd, int nbuf =4, int sz =4096, int spin =0);
+  int Next (unsigned char **chunk);
+  void Close ();
+  int Active () const {return((ring >= 0) ? 1 : 0);}
+  int Polled () const {return poll;}
+
+
+// PRIVATE MEMBER FUNCTIONS
+private:
+  // main functions
+  int map_rings (void *params);
+  int post_read (int b);
+
+};
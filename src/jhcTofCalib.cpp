@@ -0,0 +1,646 @@
+// jhcTofCalib.cpp : finds relative poses of several sensors from shared planes
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+
+#include <jhcTofCalib.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofCalib::jhcTofCalib ()
+{
+  int s;
+
+  // plane selection
+  pmin = 300;                          // min plane support (pixels)
+
+  // matching
+  atol = 20.0f;                        // initial normal mismatch (degs)
+  dtol = 150.0f;                       // initial offset mismatch (mm)
+  amin = 3.0f;                         // final normal mismatch (degs)
+  dmin = 20.0f;                        // final offset mismatch (mm)
+
+  // solving
+  rounds = 5;                          // rematch and refit passes
+  reg = 0.001f;                        // pull toward guess (fraction)
+
+  // thread arguments
+  for (s = 0; s < 8; s++)
+  {
+    job[s].me = this;
+    job[s].sensor = s;
+    img[s] = NULL;
+  }
+  Reset(2);
+}
+
+
+//= Forget all frames and results and set number of sensors to "n" (max 8).
+
+void jhcTofCalib::Reset (int n)
+{
+  int s, i;
+
+  ns = ((n < 1) ? 1 : ((n > 8) ? 8 : n));
+  nf = 0;
+  memset(npl, 0, sizeof(npl));
+  for (s = 0; s < 8; s++)
+  {
+    for (i = 0; i < 6; i++)
+      guess[s][i] = 0.0f;
+    memcpy(pose[s], guess[s], sizeof(pose[s]));
+    aerr[s] = 0.0f;
+    derr[s] = 0.0f;
+    nmat[s] = 0;
+    fixed[s] = 0;
+  }
+}
+
+
+//= Set rough pose of sensor "s" (mm and degrees), sensor 0 defines world.
+
+void jhcTofCalib::SetGuess (int s, float x, float y, float z, float pan, float tilt, float roll)
+{
+  if ((s < 0) || (s >= 8))
+    return;
+  guess[s][0] = x;
+  guess[s][1] = y;
+  guess[s][2] = z;
+  guess[s][3] = pan;
+  guess[s][4] = tilt;
+  guess[s][5] = roll;
+}
+
+
+//= Set rough pose of sensor "s" from pose parameters of a cloud.
+
+void jhcTofCalib::SetGuess (int s, const jhcTofCloud& src)
+{
+  SetGuess(s, src.cx, src.cy, src.cz, src.pan, src.tilt, src.roll);
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                           Plane Collection                            //
+///////////////////////////////////////////////////////////////////////////
+
+//= Find planes in a set of simultaneous range images (one per sensor).
+// each sensor is handled by its own thread, images are not retained
+// returns total number of usable planes found, 0 if frame storage full
+
+int jhcTofCalib::AddFrame (const unsigned char * const *range)
+{
+  pthread_t th[8];
+  int run[8];
+  int s, cnt = 0;
+
+  if (nf >= 100)
+    return 0;
+  for (s = 0; s < ns; s++)
+    img[s] = range[s];
+
+  // analyze all images in parallel (inline if thread cannot start)
+  if (ns > 1)
+  {
+    for (s = 0; s < ns; s++)
+    {
+      run[s] = 0;
+      if (pthread_create(th + s, NULL, finder, (void *)(job + s)) == 0)
+        run[s] = 1;
+      else
+        find_planes(s);
+    }
+    for (s = 0; s < ns; s++)
+      if (run[s] > 0)
+        pthread_join(th[s], NULL);
+  }
+  else
+    find_planes(0);
+
+  // frame set kept even if some sensor saw nothing
+  for (s = 0; s < ns; s++)
+    cnt += npl[s][nf];
+  nf++;
+  return cnt;
+}
+
+
+//= Thread entry point for finding planes seen by one sensor.
+
+void *jhcTofCalib::finder (void *arg)
+{
+  struct calib_job *j = (struct calib_job *) arg;
+
+  j->me->find_planes(j->sensor);
+  return NULL;
+}
+
+
+//= Save large planes (camera frame) seen by sensor "s" in current frame set.
+
+void jhcTofCalib::find_planes (int s)
+{
+  const float *n;
+  float *p;
+  int i, k = 0;
+
+  npl[s][nf] = 0;
+  if ((img[s] == NULL) || (cloud[s].Convert(img[s]) <= 0))
+    return;
+  planes[s].Analyze(cloud[s]);
+  for (i = 1; (i <= planes[s].Count()) && (k < 12); i++)
+    if (planes[s].Pixels(i) >= pmin)
+    {
+      n = planes[s].Normal(i);
+      p = pl[s][nf][k];
+      p[0] = n[0];
+      p[1] = n[1];
+      p[2] = n[2];
+      p[3] = planes[s].Offset(i);
+      pw[s][nf][k] = planes[s].Pixels(i);
+      k++;
+    }
+  npl[s][nf] = k;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                             Alignment                                 //
+///////////////////////////////////////////////////////////////////////////
+
+//= Align every sensor to sensor 0 using all collected frame sets.
+// returns number of sensors with good poses (including sensor 0)
+
+int jhcTofCalib::Solve ()
+{
+  int s, cnt = 1;
+
+  memcpy(pose[0], guess[0], sizeof(pose[0]));
+  fixed[0] = 1;
+  for (s = 1; s < ns; s++)
+  {
+    memcpy(pose[s], guess[s], sizeof(pose[s]));
+    cnt += align(s);
+  }
+  return cnt;
+}
+
+
+//= Find pose of sensor "s" which best lines up its planes with sensor 0.
+// returns 1 if successful, 0 if too few matches
+
+int jhcTofCalib::align (int s)
+{
+  int mate[12];
+  double r[9], c[3], cg[3], r0[9], c0[3], sum[9], a[9], b[3], na[3], nb[3];
+  double da, db, dot, w, ea, ed, wt;
+  float at = atol, dt = dtol;
+  const float *pb;
+  int i, j, k, f, rnd, n = 0;
+
+  // starting estimates
+  pose2mat(r0, guess[0]);
+  pose2mat(r, guess[s]);
+  for (i = 0; i < 3; i++)
+  {
+    c0[i] = guess[0][i];
+    c[i] = guess[s][i];
+    cg[i] = guess[s][i];
+  }
+  fixed[s] = 0;
+  nmat[s] = 0;
+
+  // alternately match planes and refit pose with tighter tolerances
+  for (rnd = 0; rnd < rounds; rnd++)
+  {
+    memset(sum, 0, sizeof(sum));
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    n = 0;
+    for (f = 0; f < nf; f++)
+      if (match(mate, s, f, r, c, at, dt) > 0)
+        for (j = 0; j < npl[s][f]; j++)
+          if ((k = mate[j]) >= 0)
+          {
+            // target plane in world and source plane in sensor frame
+            world_plane(na, da, pl[0][f][k], r0, c0);
+            pb = pl[s][f][j];
+            for (i = 0; i < 3; i++)
+              nb[i] = pb[i];
+            db = pb[3];
+            w = ((pw[0][f][k] < pw[s][f][j]) ? pw[0][f][k] : pw[s][f][j]);
+
+            // normal correlation and offset constraint n_a . c = d_b - d_a
+            for (i = 0; i < 9; i++)
+            {
+              sum[i] += w * nb[i / 3] * na[i % 3];
+              a[i] += w * na[i / 3] * na[i % 3];
+            }
+            for (i = 0; i < 3; i++)
+              b[i] += w * na[i] * (db - da);
+            n++;
+          }
+    if ((n < 2) || (fit_rot(r, sum, a) <= 0))
+      return 0;
+    fit_pos(c, a, b, cg);
+    at = ((0.5f * at > amin) ? 0.5f * at : amin);
+    dt = ((0.5f * dt > dmin) ? 0.5f * dt : dmin);
+  }
+
+  // residuals for final matches
+  ea = 0.0;
+  ed = 0.0;
+  wt = 0.0;
+  n = 0;
+  for (f = 0; f < nf; f++)
+    if (match(mate, s, f, r, c, at, dt) > 0)
+      for (j = 0; j < npl[s][f]; j++)
+        if ((k = mate[j]) >= 0)
+        {
+          world_plane(na, da, pl[0][f][k], r0, c0);
+          world_plane(nb, db, pl[s][f][j], r, c);
+          dot = na[0] * nb[0] + na[1] * nb[1] + na[2] * nb[2];
+          dot = ((dot < 1.0) ? dot : 1.0);
+          w = ((pw[0][f][k] < pw[s][f][j]) ? pw[0][f][k] : pw[s][f][j]);
+          ea += w * acos(dot) * acos(dot);
+          ed += w * (db - da) * (db - da);
+          wt += w;
+          n++;
+        }
+  if (wt > 0.0)
+  {
+    aerr[s] = (float)(sqrt(ea / wt) * 57.29578);
+    derr[s] = (float) sqrt(ed / wt);
+  }
+
+  // save as standard pose
+  mat2pose(pose[s], r);
+  for (i = 0; i < 3; i++)
+    pose[s][i] = (float) c[i];
+  nmat[s] = n;
+  fixed[s] = 1;
+  return 1;
+}
+
+
+//= Pair planes of sensor "s" in frame set "f" with those of sensor 0.
+// uses sensor "s" pose "r", "c" and accepts only mutual best matches
+// within "at" degrees and "dt" mm, fills "mate" with sensor 0 index or -1
+// returns number of pairs
+
+int jhcTofCalib::match (int *mate, int s, int f, const double *r, const double *c, float at, float dt) const
+{
+  double cost[12][12], wa[12][4], r0[9], c0[3], nb[4];
+  double dot, off, cmin = cos(at * 0.0174533), arad = at * 0.0174533;
+  int i, j, k, b, n0 = npl[0][f], ns = npl[s][f], n = 0;
+
+  // sensor 0 planes in world frame
+  pose2mat(r0, guess[0]);
+  for (i = 0; i < 3; i++)
+    c0[i] = guess[0][i];
+  for (k = 0; k < n0; k++)
+    world_plane(wa[k], wa[k][3], pl[0][f][k], r0, c0);
+
+  // combined angle and offset mismatch for all pairs (negative if too far)
+  for (j = 0; j < ns; j++)
+  {
+    world_plane(nb, nb[3], pl[s][f][j], r, c);
+    for (k = 0; k < n0; k++)
+    {
+      dot = nb[0] * wa[k][0] + nb[1] * wa[k][1] + nb[2] * wa[k][2];
+      off = fabs(nb[3] - wa[k][3]);
+      if ((dot < cmin) || (off > dt))
+        cost[j][k] = -1.0;
+      else
+        cost[j][k] = acos((dot < 1.0) ? dot : 1.0) / arad + off / dt;
+    }
+  }
+
+  // keep pair only if each is the other's best choice
+  for (j = 0; j < ns; j++)
+  {
+    mate[j] = -1;
+    for (k = 0; k < n0; k++)
+      if ((cost[j][k] >= 0.0) && ((mate[j] < 0) || (cost[j][k] < cost[j][mate[j]])))
+        mate[j] = k;
+    if ((k = mate[j]) < 0)
+      continue;
+    for (b = 0; b < ns; b++)
+      if ((b != j) && (cost[b][k] >= 0.0) && (cost[b][k] < cost[j][k]))
+        break;
+    if (b < ns)
+      mate[j] = -1;
+    else
+      n++;
+  }
+  return n;
+}
+
+
+//= Convert camera frame plane "p" (nx, ny, nz, d) to world frame normal "nw" and offset "dw".
+// camera to world rotation is "r" and camera position is "c"
+
+void jhcTofCalib::world_plane (double *nw, double& dw, const float *p, const double *r, const double *c) const
+{
+  nw[0] = r[0] * p[0] + r[1] * p[1] + r[2] * p[2];
+  nw[1] = r[3] * p[0] + r[4] * p[1] + r[5] * p[2];
+  nw[2] = r[6] * p[0] + r[7] * p[1] + r[8] * p[2];
+  dw = p[3] - (nw[0] * c[0] + nw[1] * c[1] + nw[2] * c[2]);
+}
+
+
+//= Find rotation "r" taking sensor normals onto world normals (Horn's method).
+// "sum" holds weighted sums of products b_i * a_j, "a" sums of a_i * a_j
+// returns 1 if okay, 0 if normals do not span at least 2 directions
+
+int jhcTofCalib::fit_rot (double *r, const double *sum, const double *a) const
+{
+  double m[16], vec[16], val[4], sa[9];
+  const double *q;
+  double sxx = sum[0], sxy = sum[1], sxz = sum[2], syx = sum[3], syy = sum[4];
+  double syz = sum[5], szx = sum[6], szy = sum[7], szz = sum[8];
+  double w, x, y, z;
+  int i, best = 0;
+
+  // need at least two distinct normal directions
+  memcpy(sa, a, sizeof(sa));
+  jacobi(val, vec, sa, 3);
+  if ((val[0] <= 0.0) || (val[1] < 0.01 * val[0]))
+    return 0;
+
+  // symmetric 4x4 whose top eigenvector is the rotation quaternion
+  m[0]  = sxx + syy + szz;
+  m[1]  = syz - szy;
+  m[2]  = szx - sxz;
+  m[3]  = sxy - syx;
+  m[5]  = sxx - syy - szz;
+  m[6]  = sxy + syx;
+  m[7]  = szx + sxz;
+  m[10] = -sxx + syy - szz;
+  m[11] = syz + szy;
+  m[15] = -sxx - syy + szz;
+  m[4]  = m[1];
+  m[8]  = m[2];
+  m[9]  = m[6];
+  m[12] = m[3];
+  m[13] = m[7];
+  m[14] = m[11];
+  jacobi(val, vec, m, 4);
+  for (i = 1; i < 4; i++)
+    if (val[i] > val[best])
+      best = i;
+
+  // convert quaternion (eigenvectors are columns) to rotation matrix
+  q = vec + best;
+  w = q[0];
+  x = q[4];
+  y = q[8];
+  z = q[12];
+  r[0] = w * w + x * x - y * y - z * z;
+  r[1] = 2.0 * (x * y - w * z);
+  r[2] = 2.0 * (x * z + w * y);
+  r[3] = 2.0 * (x * y + w * z);
+  r[4] = w * w - x * x + y * y - z * z;
+  r[5] = 2.0 * (y * z - w * x);
+  r[6] = 2.0 * (x * z - w * y);
+  r[7] = 2.0 * (y * z + w * x);
+  r[8] = w * w - x * x - y * y + z * z;
+  return 1;
+}
+
+
+//= Find sensor position "c" from offset constraints "a" c = "b".
+// adds slight pull toward guess "c0" so unconstrained directions stay put
+
+void jhcTofCalib::fit_pos (double *c, const double *a, const double *b, const double *c0) const
+{
+  double m[9], v[3], det, lam;
+  int i;
+
+  // damped normal equations
+  lam = reg * (a[0] + a[4] + a[8]) / 3.0;
+  for (i = 0; i < 9; i++)
+    m[i] = a[i];
+  for (i = 0; i < 3; i++)
+  {
+    m[4 * i] += lam;
+    v[i] = b[i] + lam * c0[i];
+  }
+
+  // Cramer's rule
+  det = m[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (m[3] * m[8] - m[5] * m[6]) +
+        m[2] * (m[3] * m[7] - m[4] * m[6]);
+  if (fabs(det) < 1e-12)
+    return;
+  c[0] = (v[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (v[1] * m[8] - m[5] * v[2]) +
+          m[2] * (v[1] * m[7] - m[4] * v[2])) / det;
+  c[1] = (m[0] * (v[1] * m[8] - m[5] * v[2]) - v[0] * (m[3] * m[8] - m[5] * m[6]) +
+          m[2] * (m[3] * v[2] - v[1] * m[6])) / det;
+  c[2] = (m[0] * (m[4] * v[2] - v[1] * m[7]) - m[1] * (m[3] * v[2] - v[1] * m[6]) +
+          v[0] * (m[3] * m[7] - m[4] * m[6])) / det;
+}
+
+
+//= Eigen decomposition of symmetric "n" x "n" matrix "m" (n <= 4) by Jacobi rotations.
+// "val" gets eigenvalues in decreasing order, "vec" has eigenvectors as columns
+// destroys contents of "m"
+
+void jhcTofCalib::jacobi (double *val, double *vec, double *m, int n) const
+{
+  double th, t, c, s, tau, mpq, mkp, mkq, tmp;
+  int p, q, k, sweep;
+
+  // start with identity
+  for (p = 0; p < n; p++)
+    for (q = 0; q < n; q++)
+      vec[p * n + q] = ((p == q) ? 1.0 : 0.0);
+
+  // zero off-diagonal elements one pair at a time
+  for (sweep = 0; sweep < 50; sweep++)
+  {
+    tmp = 0.0;
+    for (p = 0; p < n; p++)
+      for (q = p + 1; q < n; q++)
+        tmp += fabs(m[p * n + q]);
+    if (tmp < 1e-15)
+      break;
+    for (p = 0; p < n; p++)
+      for (q = p + 1; q < n; q++)
+      {
+        if ((mpq = m[p * n + q]) == 0.0)
+          continue;
+        th = (m[q * n + q] - m[p * n + p]) / (2.0 * mpq);
+        t = ((th >= 0.0) ? 1.0 : -1.0) / (fabs(th) + sqrt(th * th + 1.0));
+        c = 1.0 / sqrt(t * t + 1.0);
+        s = t * c;
+        tau = s / (1.0 + c);
+        m[p * n + p] -= t * mpq;
+        m[q * n + q] += t * mpq;
+        m[p * n + q] = 0.0;
+        m[q * n + p] = 0.0;
+        for (k = 0; k < n; k++)
+        {
+          if ((k != p) && (k != q))
+          {
+            mkp = m[k * n + p];
+            mkq = m[k * n + q];
+            m[k * n + p] = mkp - s * (mkq + tau * mkp);
+            m[k * n + q] = mkq + s * (mkp - tau * mkq);
+            m[p * n + k] = m[k * n + p];
+            m[q * n + k] = m[k * n + q];
+          }
+          mkp = vec[k * n + p];
+          mkq = vec[k * n + q];
+          vec[k * n + p] = mkp - s * (mkq + tau * mkp);
+          vec[k * n + q] = mkq + s * (mkp - tau * mkq);
+        }
+      }
+  }
+
+  // sort eigenvalues (and vector columns) largest first
+  for (p = 0; p < n; p++)
+    val[p] = m[p * n + p];
+  for (p = 0; p < n; p++)
+    for (q = p + 1; q < n; q++)
+      if (val[q] > val[p])
+      {
+        tmp = val[p];
+        val[p] = val[q];
+        val[q] = tmp;
+        for (k = 0; k < n; k++)
+        {
+          tmp = vec[k * n + p];
+          vec[k * n + p] = vec[k * n + q];
+          vec[k * n + q] = tmp;
+        }
+      }
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                           Pose Conversion                             //
+///////////////////////////////////////////////////////////////////////////
+
+//= Camera to world rotation "r" for pan, tilt, and roll in pose "p".
+// uses same conventions as jhcTofCloud (promoted to double)
+
+void jhcTofCalib::pose2mat (double *r, const float *p)
+{
+  float m[9];
+  int i;
+
+  jhcTofCloud::PoseRot(m, p[3], p[4], p[5]);
+  for (i = 0; i < 9; i++)
+    r[i] = m[i];
+}
+
+
+//= Pan, tilt, and roll (degrees) in pose "p" for camera to world rotation "r".
+// leaves position part of pose unchanged
+
+void jhcTofCalib::mat2pose (float *p, const double *r)
+{
+  double st = ((r[8] > 1.0) ? 1.0 : ((r[8] < -1.0) ? -1.0 : r[8]));
+
+  p[3] = (float)(atan2(-r[2], r[5]) * 57.29578);
+  p[4] = (float)(asin(st) * 57.29578);
+  p[5] = (float)(atan2(-r[6], -r[7]) * 57.29578);
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Results                                  //
+///////////////////////////////////////////////////////////////////////////
+
+//= Get solved pose of sensor "s" (x, y, z, pan, tilt, roll).
+// returns 1 if solved, 0 if only rough guess
+
+int jhcTofCalib::Pose (float *p, int s) const
+{
+  if ((s < 0) || (s >= ns))
+    return 0;
+  memcpy(p, pose[s], 6 * sizeof(float));
+  return fixed[s];
+}
+
+
+//= Write sensor poses to a text configuration file.
+// returns 1 if okay, 0 for file problem
+
+int jhcTofCalib::Save (const char *fname) const
+{
+  FILE *out;
+  const float *p;
+  int s;
+
+  if ((out = fopen(fname, "w")) == NULL)
+    return 0;
+  fprintf(out, "# A010 sensor poses: id x y z (mm) pan tilt roll (degs)\n");
+  for (s = 0; s < ns; s++)
+  {
+    p = pose[s];
+    fprintf(out, "sensor %d %7.1f %7.1f %7.1f %7.2f %7.2f %7.2f", s, p[0], p[1], p[2], p[3], p[4], p[5]);
+    if (fixed[s] <= 0)
+      fprintf(out, "   # guess only");
+    else if (s > 0)
+      fprintf(out, "   # %d matches, %4.2f degs, %3.1f mm rms", nmat[s], aerr[s], derr[s]);
+    fprintf(out, "\n");
+  }
+  return((fclose(out) == 0) ? 1 : 0);
+}
+
+
+//= Set pose parameters of "dest" for sensor "s" from configuration file.
+// returns 1 if okay, 0 if file or sensor entry not found
+
+int jhcTofCalib::Load (jhcTofCloud& dest, const char *fname, int s)
+{
+  char line[200];
+  FILE *in;
+  float x, y, z, pan, tilt, roll;
+  int id, ok = 0;
+
+  if ((in = fopen(fname, "r")) == NULL)
+    return 0;
+  while (fgets(line, 200, in) != NULL)
+    if ((sscanf(line, "sensor %d %f %f %f %f %f %f", &id, &x, &y, &z, &pan, &tilt, &roll) == 7) &&
+        (id == s))
+    {
+      dest.cx = x;
+      dest.cy = y;
+      dest.cz = z;
+      dest.pan = pan;
+      dest.tilt = tilt;
+      dest.roll = roll;
+      ok = 1;
+      break;
+    }
+  fclose(in);
+  return ok;
+}
@@ -26,6 +26,8 @@
 #include <termios.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
+#include <math.h>
 
 #include <jhcTofCam.h>
 
@@ -39,6 +41,8 @@
 jhcTofCam::~jhcTofCam ()
 {
   Done();
+  pthread_mutex_destroy(&data);
+  delete [] chist;
 }
 
 
@@ -46,12 +50,20 @@ jhcTofCam::~jhcTofCam ()
 
 jhcTofCam::jhcTofCam ()
 {
+  int s;
+
   // 16 bit scaling for "unit" 
   build_lut();
 
   // strip header from packet
   raw = pkt + 16;
 
+  // pixel (0, 0) of padded image on 64 byte boundary after 3 rows
+  rp = (unsigned char *)((((size_t) rbox) + 63) & ~((size_t) 63)) + 384;
+
+  // serial input
+  uring = 0;                           // 0 = read, 1 = io_uring, 2 = polled
+
   // auto-ranging
   sat = 80;                            // max frac saturated
   pct = 50;                            // histogram percentile
@@ -66,11 +78,41 @@ jhcTofCam::jhcTofCam ()
   nv = 64.0;                           // expect 3 bits noise (8^2)
   vlim = 32;                           // too much flicker
 
+  // saturated pixel recovery
+  hold = 0;                            // max frames (0 = never)
+  vh = 6;                              // variance added per frame
+
+  // time-to-contact
+  fr = 64;                             // rate update fraction (x256)
+  tmax = 3.0;                          // longest contact time (sec)
+  tx0 = 0;                             // whole image ROI
+  ty0 = 0;
+  tw  = 100;
+  th  = 100;
+
+  // change events
+  eblk = 1;                            // cell size (1 or 4 pixels)
+  etol = 10.0;                         // min depth change (mm)
+  ekey = 100;                          // full refresh (0 = first only)
+
   // procesing state
+  pthread_mutex_init(&data, NULL);
   ser = -1;
+  live = 1;
   ok = -1;
   run = 0;
   frame = 0;
+  chist = NULL;
+  cstate = 0;
+
+  // default subscriber gets every frame with all outputs
+  for (s = 0; s < 4; s++)
+  {
+    son[s] = 0;
+    slock[s] = -1;
+    ehold[s] = -1;
+  }
+  Subscribe(0.0f, 3, 0);
 }
 
 
@@ -92,17 +134,18 @@ void jhcTofCam::build_lut ()
 ///////////////////////////////////////////////////////////////////////////
 
 //= Open connection to sensor and start background acquisition thread.
-// "port" is lower COMx number in Windows Device Manager (Linux ignores)
+// "port" is lower COMx number in Windows Device Manager (Linux uses
+// /dev/ttyUSB<port> if it exists, else /dev/ttyUSB0)
 // returns 1 if okay, 0 or negative for error
 
 int jhcTofCam::Start (int port)
 {
   // establish USB serial connection
   ok = -1;
-  if (open_usb() <= 0)
+  if (open_usb(port) <= 0)
   {
     pwr_cycle();                       // re-initialize
-    if (open_usb() <= 0)
+    if (open_usb(port) <= 0)
       return ok;
   }
 
@@ -110,14 +153,77 @@ int jhcTofCam::Start (int port)
   write(ser, "AT+DISP=3\r", 10);       // needs live display!
   usleep(50000);                       // 50ms min between commands
   write(ser, "AT+UNIT=2\r", 10);       // 2mm depth step                 
+  live = 1;
+  return launch();
+}
+
+
+//= Play back a byte stream saved by Record instead of using live sensor.
+// recording should be started before Start so initial "unit" matches
+// frames are released at nominal sensor rate based on header frame ids
+// returns 1 if okay, 0 or negative for error
+
+int jhcTofCam::Replay (const char *fname)
+{
+  ok = -1;
+  if ((fname == NULL) || ((ser = open(fname, O_RDONLY)) < 0))
+    return ok;
+  live = 0;
+  return launch();
+}
+
+
+//= Save exact received serial byte stream (including AT replies) to file.
+// copying is done by a separate writer thread with large aligned blocks
+// call before Start so Replay begins with correct sensor "unit"
+// file cannot be changed while streaming since receiver thread writes to it
+// (Done finishes recording), a NULL or empty name just closes old file
+// returns 1 if file opened, 0 if not, negative if streaming
+
+int jhcTofCam::Record (const char *fname)
+{
+  if (run > 0)
+    return -1;
+  tee.Close();
+  return tee.Open(fname);
+}
+
+
+//= Initialize processing state and start background acquisition thread.
+// returns 1 if okay, 0 or negative for error
+
+int jhcTofCam::launch ()
+{
+  int s;
+
+  // sensor begins in 2mm depth step mode
   unit = 2;
   pend = 2;   
-
-  // initialize rotating buffers
-  fill = d0;
-  done = NULL;
-  lock = NULL;
-  fresh = -2;                          // first 2 are stale                       
+  jump = 0;
+
+  // possibly receive bytes using pre-posted io_uring reads
+  // (not for playback since several reads of a file could finish out of order)
+  rn = 0;
+  if ((uring > 0) && (live > 0))
+    if (urx.Open(ser, 4, 4096, uring - 1) <= 0)
+      printf(">>> jhcTofCam: io_uring not available, using read()\n");
+
+  // initialize image pool and subscriber queues
+  ifill = 0;
+  fill = dimg[0];
+  mfill = info;
+  stale = 2;                           // first 2 are stale                       
+  for (s = 0; s < 4; s++)
+  {
+    snew[s] = -1;
+    slock[s] = -1;
+    epend[s] = -1;
+    ehold[s] = -1;
+    efill[s] = 0;
+    ecnt[s] = 0;
+    snext[s] = 0;
+  }
+  clk.Reset();
 
   // launch receiver and pre-processor thread
   run = 1;
@@ -128,15 +234,20 @@ int jhcTofCam::Start (int port)
 
 
 //= Try opening USB connection to sensor as a serial port.
-// binds "ser" to port and sets overall "ok" flag
+// "port" selects device file (ttyUSB0 if missing), binds "ser" to it
+// and sets overall "ok" flag
 // returns 1 if okay, 0 or negative for error
 
-int jhcTofCam::open_usb ()
+int jhcTofCam::open_usb (int port)
 {
+  char dev[40];
   struct termios tty;
 
   // open USB connection to camera
-  ser = open("/dev/ttyUSB0", O_RDWR | O_NOCTTY | O_NDELAY);
+  sprintf(dev, "/dev/ttyUSB%d", port);
+  if (access(dev, F_OK) != 0)
+    strcpy(dev, "/dev/ttyUSB0");       // no such device (Windows number)
+  ser = open(dev, O_RDWR | O_NOCTTY | O_NDELAY);
   if (ser < 0)
     return -1;
   fcntl(ser, F_SETFL, 0);              // clear status
@@ -191,20 +302,20 @@ void jhcTofCam::pwr_cycle () const
 }
 
 
-//= Get a pointer to the most recent 16 bit depth image from sensor.
+//= Get a pointer to the most recent 16 bit depth image for subscriber "sub".
 // buffer is always 100 x 100 with 16 bit pixels and 0.25mm resolution 
 // with USB on left: scans right-to-left, top-down from upper right corner
 // typically 14.8 fps, image guaranteed unchanged until next Range() call
 // returns pixel buffer pointer, NULL if not ready or stream broken
 
-const unsigned char *jhcTofCam::Range (int block)
+const unsigned char *jhcTofCam::Range (int block, int sub)
 {
   int wait = 0;
 
   // check if source is operational and new frame is ready
-  if (ok <= 0)  
+  if ((ok <= 0) || (sub < 0) || (sub >= 4) || (son[sub] <= 0))  
     return NULL;
-  while (fresh <= 0)
+  while (snew[sub] < 0)
   {
     if (block <= 0)                    // return immediately
       return NULL;
@@ -215,10 +326,100 @@ const unsigned char *jhcTofCam::Range (int block)
 
   // swap buffers to be sure output pointer remains valid
   pthread_mutex_lock(&data);
-  lock = done;                         // mark as in-use
-  fresh = 0;
+  slock[sub] = snew[sub];               // mark as in-use
+  ehold[sub] = epend[sub];
+  snew[sub] = -1;
+  epend[sub] = -1;
+  pthread_mutex_unlock(&data);
+  return dimg[slock[sub]];
+}
+
+
+//= Get time-to-contact map (ms) that goes with image from last Range().
+// 100 x 100 with 16 bit pixels, 65535 if not approaching (or invalid)
+// returns pixel buffer pointer, NULL if no image yet or not computed
+
+const unsigned char *jhcTofCam::Contact (int sub) const
+{
+  const jhcTofMeta *m = Info(sub);
+
+  if ((m == NULL) || ((m->outs & 0x01) == 0))
+    return NULL;
+  return((const unsigned char *) tmap[slock[sub]]);
+}
+
+
+//= Get list of changed depths that goes with image from last Range().
+// starts with grid width (100 pixels or 25 blocks) then 1 if full refresh
+// followed by runs: first cell index, cell count, then each 16 bit depth
+// blocks are 4x4 pixels with depth being the average of valid pixels
+// a cell is sent when its depth moves more than "etol" from last sent value
+// each subscriber asking for events has its own list relative to what it got
+// "n" is set to number of 16 bit words in list
+// returns list pointer, NULL if no image yet or not requested
+
+const unsigned short *jhcTofCam::Events (int& n, int sub) const
+{
+  n = 0;
+  if ((sub < 0) || (sub >= 4) || (ehold[sub] < 0))
+    return NULL;
+  n = elen[sub][ehold[sub]];
+  return elist[sub][ehold[sub]];
+}
+
+
+//= Add or change a subscriber wanting images at "fps" (0 = every frame).
+// "outs" is a bit mask of optional outputs: 1 = time-to-contact, 2 = events
+// uses slot "sub" if non-negative (0 is default for Range) else a free one
+// returns subscriber number, negative if none available
+
+int jhcTofCam::Subscribe (float fps, int outs, int sub)
+{
+  int s = sub;
+
+  pthread_mutex_lock(&data);
+  if (s < 0)
+    for (s = 1; s < 4; s++)
+      if (son[s] <= 0)
+        break;
+  if ((s < 0) || (s >= 4))
+  {
+    pthread_mutex_unlock(&data);
+    return -1;
+  }
+
+  // reset rate and event history for new selection
+  if (son[s] <= 0)
+  {
+    snew[s] = -1;
+    slock[s] = -1;
+    epend[s] = -1;
+    ehold[s] = -1;
+    efill[s] = 0;
+  }
+  sfps[s] = fps;
+  sout[s] = outs;
+  snext[s] = 0;
+  ecnt[s] = 0;
+  son[s] = 1;
+  pthread_mutex_unlock(&data);
+  return s;
+}
+
+
+//= Stop delivering images to subscriber "sub" and release its buffers.
+
+void jhcTofCam::Unsubscribe (int sub)
+{
+  if ((sub < 0) || (sub >= 4))
+    return;
+  pthread_mutex_lock(&data);
+  son[sub] = 0;
+  snew[sub] = -1;
+  slock[sub] = -1;
+  epend[sub] = -1;
+  ehold[sub] = -1;
   pthread_mutex_unlock(&data);
-  return lock;
 }
 
 
@@ -236,13 +437,20 @@ void jhcTofCam::Done ()
   // stop transmitter and release serial port
   if (ser >= 0)
   {
-    write(ser, "AT+UNIT=0\r", 10);     // stretched depth
-    usleep(50000);
-    write(ser, "AT+DISP=1\r", 10);
+    if (live > 0)
+    {
+      write(ser, "AT+UNIT=0\r", 10);   // stretched depth
+      usleep(50000);
+      write(ser, "AT+DISP=1\r", 10);
+    }
+    urx.Close();
     close(ser);
     ser = -1;
   }
 
+  // finish any recording
+  tee.Close();
+
   // mark as un-initialized
   ok = -1;
 }
@@ -272,12 +480,16 @@ void *jhcTofCam::absorb (void *tof)
       printf(">>> jhcTofCam: Image pixels timeout!\n");
       break;
     }
+    me->time_frame();
+    me->schedule();
     
     // analyze and filter image
-    me->auto_range();
+    me->pad_raw();
     me->median5x5();
+    me->auto_range();
     me->flywheel();
     me->reformat();
+    me->cap_frame();
     me->swap_bufs();
   }
   me->ok = 0;                          // stream ended               
@@ -290,34 +502,38 @@ void *jhcTofCam::absorb (void *tof)
 
 int jhcTofCam::sync () 
 {
-  unsigned char b;
-  int start = 0;
+  timespec ts;
+  int b, start = 0;
 
   // find start of next packet
   while (1)
   {      
     // start code = 0x00 0xFF
     start++;
-    if (read(ser, &b, 1) <= 0)
+    if ((b = rx_byte()) < 0)
       return 0;
     if (b != 0x00)
       continue;
-    if (read(ser, &b, 1) <= 0)
+    if ((b = rx_byte()) < 0)
       return 0;
     if (b != 0xFF)
       continue;
 
     // packet length 10016 = 0x2720 (little-endian)
-    if (read(ser, &b, 1) <= 0)
+    if ((b = rx_byte()) < 0)
       return 0;
     if (b != 0x20)
       continue;
-    if (read(ser, &b, 1) <= 0)
+    if ((b = rx_byte()) < 0)
       return 0;
     if (b == 0x27)
       break;
   }
 
+  // remember when packet started arriving
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  arrive = (long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+
   // assume extra bytes are response to "unit" command
   if ((start > 1) && (frame > 2))
     depth_step();
@@ -327,39 +543,191 @@ int jhcTofCam::sync ()
 
 //= Fills the "raw" image buffer with received serial bytes.
 // whole packet = 16 byte header + 10000 byte image + 2 bytes at end
+// plain reads go straight into packet and only wait if short
 // returns 1 when successful, 0 if stream broken
 
 int jhcTofCam::fill_raw ()
 {
   int rc, n = 0;                      
 
-  while (1)
+  while (n < 10018)
   {
-    rc = read(ser, pkt + n, 10018 - n);
+    // use up bytes left from start search or io_uring chunk
+    if ((rn > 0) || (urx.Active() > 0))
+    {
+      if ((rn <= 0) && (rx_fill() <= 0))
+        return 0;                      // timeout
+      rc = 10018 - n;
+      rc = ((rn < rc) ? rn : rc);
+      memcpy(pkt + n, rx, rc);
+      rx += rc;
+      rn -= rc;
+      n += rc;
+      continue;
+    }
+
+    // read rest of packet directly into buffer
+    rc = (int) read(ser, pkt + n, 10018 - n);
     if (rc <= 0)
       return 0;                        // timeout
+    tee.Add(pkt + n, rc);              // possibly record
     n += rc;
-    if (n >= 10018) 
-      break;
-    usleep(17500);                     // accumulate more bytes
+    if (n < 10018)
+      usleep(17500);                   // accumulate more bytes
   }
   return 1;
 }
 
 
-//= Mark filtering as completed and shuffle output images.
+//= Get next received serial byte, refilling buffer if needed.
+// returns byte value, negative if stream broken
+
+int jhcTofCam::rx_byte ()
+{
+  if ((rn <= 0) && (rx_fill() <= 0))
+    return -1;
+  rn--;
+  return *rx++;
+}
+
+
+//= Get next chunk of serial bytes from sensor.
+// uses completed io_uring read (next already posted) or plain read()
+// returns number of bytes available, 0 or negative if stream broken
+
+int jhcTofCam::rx_fill ()
+{
+  if (urx.Active() > 0)
+    rn = urx.Next(&rx);
+  else
+  {
+    rx = rbuf;
+    rn = (int) read(ser, rbuf, 4096);
+  }
+  if (rn > 0)
+  {
+    tee.Add(rx, rn);                   // possibly record
+    return rn;
+  }
+  rn = 0;
+  return 0;
+}
+
+
+//= Estimate true capture time of current frame from header frame id.
+// arrival times jitter by several ms due to USB buffering
+// id is 12 bits in packet header (offset 16 past start code)
+
+void jhcTofCam::time_frame ()
+{
+  mfill->fid = pkt[12] | ((pkt[13] & 0x0F) << 8);
+  if (live <= 0)
+    pace(mfill->fid);
+  mfill->tstamp = clk.Update(arrive, mfill->fid);
+  mfill->terr = (float) clk.Error();
+}
+
+
+//= Delay playback so frames appear at nominal sensor rate.
+// computes ideal arrival time from difference in frame ids
+
+void jhcTofCam::pace (int id)
+{
+  timespec ts;
+  long long now, d;
+
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  now = (long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+  if (frame <= 0)
+    tpace = now;
+  else
+  {
+    d = (id - pid) & 0x0FFF;
+    tpace += (d * 1000000000LL * 10) / 148;        // 14.8 fps
+    if (tpace > now)
+      usleep((useconds_t)((tpace - now) / 1000));
+    else
+      tpace = now;                     // fell behind
+  }
+  arrive = tpace;
+  pid = id;
+}
+
+
+//= Decide which subscribers get the current frame based on their rates.
+// a frame is taken if within half a frame period of the desired time
+// notes whether any of these need time-to-contact map or change events
+
+void jhcTofCam::schedule ()
+{
+  long long now = mfill->tstamp, slop = (long long)(500000.0 * clk.Period()), per;
+  int s;
+
+  cwant = 0;
+  for (s = 0; s < 4; s++)
+  {
+    sdue[s] = 0;
+    sev[s] = 0;
+    if ((stale > 0) || (son[s] <= 0))
+      continue;
+    if (sfps[s] > 0.0f)
+    {
+      // restart schedule if badly behind
+      if (now < (snext[s] - slop))
+        continue;
+      per = (long long)(1000000000.0 / sfps[s]);
+      snext[s] = (((now - snext[s]) > per) ? now : snext[s]) + per;
+    }
+    sdue[s] = 1;
+    if ((sout[s] & 0x01) != 0)
+      cwant = 1;
+    if ((sout[s] & 0x02) != 0)
+      sev[s] = 1;
+  }
+  mfill->outs = cwant;
+}
+
+
+//= Mark filtering as completed and give image to subscribers that are due.
+// picks next image to fill as one not pending or locked by any subscriber
 
 void jhcTofCam::swap_bufs ()
 {
+  int s, i;
+
+  // keep change events complete if last list is being replaced unread
+  // (locked so Range cannot take or release lists during merge)
   pthread_mutex_lock(&data);
-  done = fill;                         // most recent complete
-  fresh += 1;
-  if (fill == d0)
-    fill = ((lock != d1) ? d1 : d2);
-  else if (fill == d1)
-    fill = ((lock != d0) ? d0 : d2);
-  else                                 // lock == d2             
-    fill = ((lock != d0) ? d0 : d1);
+  for (s = 0; s < 4; s++)
+    if ((sev[s] > 0) && (epend[s] >= 0))
+      ev_merge(s);
+  if (stale > 0)
+    stale--;
+  for (s = 0; s < 4; s++)
+    if ((son[s] > 0) && (sdue[s] > 0))
+    {
+      snew[s] = ifill;                 // most recent complete
+      if (sev[s] <= 0)
+        continue;
+      epend[s] = efill[s];
+      for (i = 0; i < 3; i++)
+        if ((i != epend[s]) && (i != ehold[s]))
+          break;
+      efill[s] = i;
+    }
+
+  // find free pool image
+  for (i = 0; i < 9; i++)
+  {
+    for (s = 0; s < 4; s++)
+      if ((son[s] > 0) && ((snew[s] == i) || (slock[s] == i)))
+        break;
+    if (s >= 4)
+      break;
+  }
+  ifill = i;
+  fill = dimg[i];
+  mfill = info + i;
   pthread_mutex_unlock(&data);
   frame++;                             // increment frame count
 }
@@ -369,44 +737,92 @@ void jhcTofCam::swap_bufs ()
 //                            Image Filtering                            //
 ///////////////////////////////////////////////////////////////////////////
 
-//= Median filter "raw" image with 5x5 mask to give "med" image.
+//= Copy "raw" image into padded plane "rp" with 2 pixel replicated borders.
+// rows are 128 bytes apart so each starts 64 byte aligned, right border
+// follows the row while left border sits at the end of the previous row
+
+void jhcTofCam::pad_raw ()
+{
+  unsigned char *d = rp;
+  const unsigned char *s = raw;
+  int y;
+
+  // copy rows and replicate end pixels
+  for (y = 0; y < 100; y++, d += 128, s += 100)
+  {
+    memcpy(d, s, 100);
+    d[-2]  = s[0];
+    d[-1]  = s[0];
+    d[100] = s[99];
+    d[101] = s[99];
+  }
+
+  // replicate top and bottom rows (including borders)
+  memcpy(rp - 258, rp - 2, 104);
+  memcpy(rp - 130, rp - 2, 104);
+  memcpy(rp + 12798, rp + 12670, 104);
+  memcpy(rp + 12926, rp + 12670, 104);
+}
+
+
+//= Median filter padded "raw" image with 5x5 mask to give "med" image.
 // updates histogram by removing box back edge and adding front edge
 // keeps track of lowest values in histogram to reduce scanning
+// border in "rp" supplies edge copies so no coordinate clamping is needed
+// also histograms frame and auto-range ROI as pixels enter bottom of box
 // takes about 1ms on Pi 4 (3.5x faster than straightforward coding)
 
 void jhcTofCam::median5x5 ()
 {
-  int x, y, i, j, now, nowx, pel, hi, sub, bot, v, cnt; 
+  int x, y, i, j, pel, hi, sub, bot, v, cnt, row, last, c0, c1; 
+  int *fh = mfill->hist, *rh = mfill->rhist;
   unsigned char *d = med;
-  const unsigned char *s = raw;
+  const unsigned char *s, *s0 = rp - 256;
  
+  // top 2 rows never enter at bottom of box
+  memset(fh, 0, 256 * sizeof(int));
+  memset(rh, 0, 256 * sizeof(int));
+  for (row = 0; row < 2; row++)
+  {
+    c0 = (((row >= cy0) && (row < cy0 + ch)) ? cx0 : 0);
+    c1 = (((row >= cy0) && (row < cy0 + ch)) ? cx0 + cw : 0);
+    for (x = 0; x < 100; x++)
+    {
+      pel = rp[(row << 7) + x];
+      fh[pel] += 1;
+      if ((x >= c0) && (x < c1))
+        rh[pel] += 1;
+    }
+  }
+
   // apply 5x5 median filter over each row of image 
-  for (y = 0; y < 10000; y += 100)
+  for (y = 0; y < 100; y++, s0 += 128)
   {
     // set up histogram for x = 0 edge:  -2  -1   x  +1  +2
-    //                           pixel:  s0  s0  s0  s1  s2        
     for (i = 0; i < 256; i++)                 
       vals[i] = 0;
     bot = 255;
-    for (j = -200; j < 300; j += 100)            // 5 rows high
-    {
-      // copy top or bottom rows if needed
-      now = y + j;
-      now = ((now <= 0) ? 0 : ((now < 9900) ? now : 9900));
-
-      // 3 left values (copies of s0) 
-      pel = *(s + now);                          // left edge pixel
-      bot = ((pel < bot) ? pel : bot);
-      vals[pel] += 3;                    
-  
-      // 2 right values
-      pel = *(s + now + 1);
-      bot = ((pel < bot) ? pel : bot);
-      vals[pel] += 1;
-      pel = *(s + now + 2);
-      bot = ((pel < bot) ? pel : bot);
-      vals[pel] += 1;
-    }
+    for (j = 0; j < 640; j += 128)             // 5 rows high
+      for (i = -2; i <= 2; i++)
+      {
+        pel = s0[j + i];
+        bot = ((pel < bot) ? pel : bot);
+        vals[pel] += 1;
+      }
+
+    // count new bottom row pixels unless it is a border copy
+    row = y + 2;
+    last = ((row < 100) ? 96 : -1);
+    c0 = (((row >= cy0) && (row < cy0 + ch)) ? cx0 : 0);
+    c1 = (((row >= cy0) && (row < cy0 + ch)) ? cx0 + cw : 0);
+    for (x = 0; x <= 2; x++)
+      if (last >= 0)
+      {
+        pel = s0[512 + x];
+        fh[pel] += 1;
+        if ((x >= c0) && (x < c1))
+          rh[pel] += 1;
+      }
 
     // evaluate 5x5 patch at current position (histogram is up to date)
     for (x = 0; x < 100; x++, d++)
@@ -432,30 +848,30 @@ void jhcTofCam::median5x5 ()
 
       // subtract off old column on left: [-2] -1   x  +1  +2  +3
       //                        new span:       *   *  x'   *   *        
-      nowx = x - 2;
-      nowx = ((nowx <= 0) ? 0 : nowx);
-      for (j = -200; j < 300; j += 100)          // 5 rows high
+      s = s0 + x - 2;
+      for (j = 0; j < 640; j += 128)           // 5 rows high
       {
-        now = y + j; 
-        now = ((now <= 0) ? 0 : ((now < 9900) ? now : 9900));
-        pel = *(s + now + nowx);
-        if ((pel == bot) && (vals[pel] <= 1))    // replace bot
+        pel = s[j];
+        if ((pel == bot) && (vals[pel] <= 1))  // replace bot
           bot = lowest[++cnt];         
         vals[pel] -= 1;
       }
 
       // add in next column on right: -2  -1   x  +1  +2 [+3]
       //                    new span:      *   *  x'   *   *        
-      nowx = x + 3; 
-      nowx = ((nowx < 99) ? nowx : 99);          // copy right edge if needed
-      for (j = -200; j < 300; j += 100)          // 5 rows high
+      s = s0 + x + 3;
+      for (j = 0; j < 640; j += 128)           // 5 rows high
       {
-        now = y + j; 
-        now = ((now <= 0) ? 0 : ((now < 9900) ? now : 9900));
-        pel = *(s + now + nowx);
+        pel = s[j];
         bot = ((pel < bot) ? pel : bot);
         vals[pel] += 1;
       }
+      if (x <= last)
+      {
+        fh[pel] += 1;
+        if ((x + 3 >= c0) && (x + 3 < c1))
+          rh[pel] += 1;
+      }
     }
   }
 }
@@ -469,25 +885,51 @@ void jhcTofCam::median5x5 ()
 //                                     and d is a time decay constant 
 //
 // smoothed values are in "avg" and variance estimates in "var"
+// if "hold" > 0 then saturated pixels coast on their old average 
+// with variance growing by "vh" each frame (count kept in "age")
+// also smooths filter increments into a depth rate for each pixel 
+// then gives time-to-contact map for approaching pixels (ms) if wanted
 
 void jhcTofCam::flywheel ()
 {
   int fi = (int)(256.0 * f0 + 0.5), cfi = 256 - fi;
-  int i, diff, vm, k, val, mn = (int)(256.0 * nv + 0.5);
-  unsigned char *p = avg, *v = var;
-  const unsigned char *m = med;
+  int per = (int)(clk.Period() + 0.5), cap = (int)(1000.0 * tmax + 0.5);
+  int i, diff, vm, k, val, dz, t, mn = (int)(256.0 * nv + 0.5);
+  unsigned short *c = tmap[ifill];
+  unsigned char *p = avg, *v = var, *a = age;
+  const unsigned char *m = med, *s = raw;
+  int *r = rate;
 
   // if first frame then initialize average and variance
   if (frame <= 0)
   {
     memcpy(p, m, 10000);     // copy source
     memset(v, 0, 10000);     // no flickering
+    memset(a, 0, 10000);     // nothing saturated
+    memset(r, 0, sizeof(rate));
+    memset(c, 0xFF, 20000);
+    contact(c);
     return;
   }
 
   // project from last step and add in new measurement 
-  for (i = 10000; i > 0; i--, m++, p++, v++)
+  cap = ((cap < 65534) ? cap : 65534);
+  for (i = 10000; i > 0; i--, m++, p++, v++, a++, s++, r++, c++)
   {
+    // possibly skip update for saturated pixel and reduce confidence
+    *c = 65535;
+    if (hold > 0)
+    {
+      if (*s >= 255)
+      {
+        *a   = ((*a < 255) ? *a + 1 : 255);
+        val  = *v + vh;
+        *v   = ((val < 255) ? val : 255);
+        continue;
+      }
+      *a = 0;
+    }
+
     // see how much raw pixels are varying to get mix factor
     diff = (*m) - (*p);
     vm   = cfi * (*v) + fi * diff * diff;
@@ -498,25 +940,211 @@ void jhcTofCam::flywheel ()
     *p   = ((val <= 0) ? 0 : ((val < 255) ? val : 255));
     val  = ((256 - k) * (vm >> 1) + 16384) >> 15;
     *v   = ((val <= 0) ? 0 : ((val < 255) ? val : 255));
+
+    // smooth average change per frame (1/64 mm) and get contact time
+    dz   = (k * diff * unit) >> 2;
+    *r  += ((dz - *r) * fr + 128) >> 8;
+    if ((cwant > 0) && (*r < 0) && (*p > 0) && (*p < 255))
+    {
+      t  = (((*p) * unit * per) << 6) / -(*r);
+      *c = (unsigned short)((t <= cap) ? t : 65535);
+    }
   }
+  contact(c - 10000);
+}
+
+
+//= Find minimum time-to-contact in ROI and record it with frame.
+// sets "ttc" negative if nothing in ROI is approaching (or map not wanted)
+
+void jhcTofCam::contact (const unsigned short *c)
+{
+  int x, y, t, best = 65535, skip = 100 - tw;
+  const unsigned short *s = c + 100 * ty0 + tx0;
+
+  mfill->ttc = -1.0f;
+  mfill->tx  = -1;
+  mfill->ty  = -1;
+  if (cwant <= 0)
+    return;
+  for (y = 0; y < th; y++, s += skip)
+    for (x = 0; x < tw; x++, s++)
+      if ((t = *s) < best)
+      {
+        best = t;
+        mfill->tx = tx0 + x;
+        mfill->ty = ty0 + y;
+      }
+  if (best < 65535)
+    mfill->ttc = 0.001f * best;
 }
 
 
 //= Mask unreliable pixels and convert to 16 bit in "done" image.
 // ignore if bad sensor, bad average, or high variance
+// saturated pixels kept if held (by flywheel) for only a few frames
+// also summarizes frame quality in associated information
+// and builds change-only event lists in same pass (or from block sums)
 
 void jhcTofCam::reformat ()
 {
-  int i;
+  int i, b, k, s, val, ns = 0, nsat = 0, nmot = 0, nok = 0, vsum = 0;
+  int blk = ((eblk >= 4) ? 4 : 1), tol = (int)(4.0 * etol + 0.5);
   const unsigned short *sc = norm[unit - 1];
-  unsigned short *d = (unsigned short *) fill;
-  const unsigned char *s = raw, *p = avg, *v = var;
+  unsigned short *e, *d = (unsigned short *) fill;
+  const unsigned char *src = raw, *p = avg, *v = var, *a = age;
+  int es[4];
+
+  // start event lists with grid width and whether full refresh
+  for (s = 0; s < 4; s++)
+    if (sev[s] > 0)
+    {
+      e = elist[s][efill[s]];
+      e[0] = (unsigned short)(100 / blk);
+      e[1] = (unsigned short)(((ecnt[s] <= 0) || (blk != emode[s]) || 
+                               ((ekey > 0) && ((ecnt[s] % ekey) == 0))) ? 1 : 0);
+      emode[s] = blk;
+      ecnt[s] += 1;
+      en[s] = 2;
+      ehd[s] = -1;
+      es[ns++] = s;
+    }
+  if ((ns > 0) && (blk > 1))
+  {
+    memset(bsum, 0, sizeof(bsum));
+    memset(bcnt, 0, sizeof(bcnt));
+  }
+
+  for (i = 0; i < 10000; i++, d++, src++, p++, v++, a++)
+  {
+    // check for bad sensor and bad average
+    val = 65535;
+    if (*src >= 255) 
+      nsat++;
+    if (((*src < 255) || ((*a > 0) && (*a <= hold))) && (*p < 255))
+    {
+      // check for too much flicker (usually motion)
+      if (*v > vlim)
+        nmot++;
+      else
+      {
+        // adjust for "unit" resolution
+        val = sc[*p];
+        vsum += *v;
+        nok++;
+      }
+    }
+    *d = (unsigned short) val;
+
+    // compare pixel to last sent or accumulate block average
+    if (ns <= 0)
+      continue;
+    if (blk <= 1)
+      for (k = 0; k < ns; k++)
+        ev_cell(es[k], (unsigned short *) fill, i, val, tol, 0);
+    else if (val < 65535)
+    {
+      b = 25 * (i / 400) + ((i % 100) >> 2);
+      bsum[b] += val;
+      bcnt[b] += 1;
+    }
+  }
+
+  // compare blocks with at least half their pixels valid
+  if ((ns > 0) && (blk > 1))
+    for (b = 0; b < 625; b++)
+    {
+      bval[b] = (unsigned short)((bcnt[b] >= 8) ? bsum[b] / bcnt[b] : 65535);
+      for (k = 0; k < ns; k++)
+        ev_cell(es[k], bval, b, bval[b], tol, 0);
+    }
+  for (k = 0; k < ns; k++)
+    elen[es[k]][efill[es[k]]] = en[es[k]];
+
+  // record quality of frame
+  mfill->valid = 0.0001f * nok;
+  mfill->satd = 0.0001f * nsat;
+  mfill->mvar = ((nok > 0) ? (vsum * unit * unit) / (float) nok : 0.0f);
+  mfill->motion = ((nsat < 10000) ? nmot / (float)(10000 - nsat) : 0.0f);
+  mfill->jump = jump;
+  jump = 0;
+}
+
+
+//= Add cell "i" with depth "val" to event list of subscriber "s" if changed enough.
+// cells must arrive in order, values of earlier cells are in grid "g"
+// changes at most 2 cells apart share a run by also sending cells between
+// always adds cell if list is a full refresh or "force" > 0
+
+void jhcTofCam::ev_cell (int s, const unsigned short *g, int i, int val, int tol, int force)
+{
+  unsigned short *e = elist[s][efill[s]], *r = eref[s];
+  int j, ref = r[i];
+
+  // valid to invalid (or reverse) is always a change
+  if ((force <= 0) && (e[1] <= 0) && 
+      ((val == 65535) == (ref == 65535)) && (abs(val - ref) <= tol))
+    return;
+
+  // extend current run or start a new one
+  if ((ehd[s] >= 0) && ((i - elast[s]) <= 3))
+    for (j = elast[s] + 1; j < i; j++)
+    {
+      e[en[s]++] = g[j];
+      r[j] = g[j];
+      e[ehd[s] + 1] += 1;
+    }
+  else
+  {
+    ehd[s] = en[s];
+    e[en[s]++] = (unsigned short) i;
+    e[en[s]++] = 0;
+  }
+
+  // add new value and remember it as last sent
+  e[en[s]++] = (unsigned short) val;
+  e[ehd[s] + 1] += 1;
+  r[i] = (unsigned short) val;
+  elast[s] = i;
+}
+
+
+//= Fold in changes from unread pending list of subscriber "s" so none are lost.
+// cells in either list are resent with latest values, full if either is
+// must be called with "data" mutex held so pending list cannot be taken
+
+void jhcTofCam::ev_merge (int s)
+{
+  unsigned short *e = elist[s][efill[s]];
+  const unsigned short *old = elist[s][epend[s]], *src;
+  int i, k, len, n = e[0] * e[0];
+
+  // new list already has everything if full refresh
+  if (e[1] > 0)
+    return;
+  if (old[1] > 0)
+    memset(emark, 1, n);
+  else
+  {
+    // mark cells mentioned in runs of either list
+    memset(emark, 0, n);
+    for (i = 0; i < 2; i++)
+    {
+      src = ((i <= 0) ? old : e);
+      len = ((i <= 0) ? elen[s][epend[s]] : elen[s][efill[s]]);
+      for (k = 2; k < len; k += 2 + src[k + 1])
+        memset(emark + src[k], 1, src[k + 1]);
+    }
+  }
 
-  for (i = 0; i < 10000; i++, d++, s++, p++, v++)
-    if ((*s >= 255) || (*p >= 255) || (*v > vlim)) 
-      *d = 65535;
-    else 
-      *d = sc[*p];           // adjust for "unit" resolution
+  // rebuild list from last sent values
+  e[1] = old[1];
+  en[s] = 2;
+  ehd[s] = -1;
+  for (i = 0; i < n; i++)
+    if (emark[i] > 0)
+      ev_cell(s, eref[s], i, eref[s][i], 0, 1);
+  elen[s][efill[s]] = en[s];
 }
 
 
@@ -524,26 +1152,28 @@ void jhcTofCam::reformat ()
 //                            Range Adjustment                             //
 /////////////////////////////////////////////////////////////////////////////
 
-//= Histogram center of image to select better depth resolution.
+//= Summarize sensor histograms made by median filter as depth percentiles.
+// picks new depth resolution from ROI histogram if auto-ranging allowed
 // sets "pend" as the newly requested resolution for "unit"
 
 void jhcTofCam::auto_range ()
 {
   char cmd[20] = "AT+UNIT=2\r";
-  int area = cw * ch, skip = 100 - cw;
-  int x, y, miss, stop, bulk, goal, sum = 0;
-  const unsigned char *s = raw + 100 * cy0 + cx0;
+  const int *cent = mfill->rhist;
+  int area = cw * ch;
+  int miss, stop, bulk, goal, cap, sum = 0;
 
-  // first few frames have bad data
-  if (frame < 2)
-    return;
+  // publish distribution of depths in this frame
+  mfill->step = unit;
+  hist_pcts(mfill->dpct, mfill->hist);
+  hist_pcts(mfill->rpct, mfill->rhist);
 
-  // histogram pixels in center of raw image
-  for (bulk = 0; bulk < 256; bulk++)
-    cent[bulk] = 0;
-  for (y = 0; y < ch; y++, s += skip)
-    for (x = 0; x < cw; x++, s++)
-      cent[*s] += 1;
+  // first few frames have bad data (or precise capture in progress)
+  pthread_mutex_lock(&data);
+  cap = cstate;
+  pthread_mutex_unlock(&data);
+  if ((frame < 2) || (cap == 1) || (cap == 2))
+    return;
 
   // find fraction saturated and intensity for given percentile
   miss = (int)((100.0 * cent[255]) / area + 0.5);
@@ -566,7 +1196,38 @@ void jhcTofCam::auto_range ()
   {
     pend = goal;
     cmd[8] = '0' + pend;
-    write(ser, cmd, 10);               // needs confirmation
+    if (live > 0)
+      write(ser, cmd, 10);               // needs confirmation
+  }
+}
+
+
+//= Find 10th, 50th, and 90th percentile depths (mm) in sensor histogram "h".
+// ignores saturated values, all percentiles negative if nothing valid
+
+void jhcTofCam::hist_pcts (float *p, const int *h) const
+{
+  int i, bin, stop, sum = 0, n = 0;
+
+  for (bin = 0; bin < 255; bin++)
+    n += h[bin];
+  bin = 0;
+  for (i = 0; i < 3; i++)
+  {
+    if (n <= 0)
+    {
+      p[i] = -1.0f;
+      continue;
+    }
+    stop = (n * (4 * i + 1) + 5) / 10;
+    stop = ((stop > 0) ? stop : 1);
+    for (; bin < 255; bin++)
+    {
+      if ((sum + h[bin]) >= stop)
+        break;
+      sum += h[bin];
+    }
+    p[i] = (float)(unit * bin);
   }
 }
 
@@ -595,6 +1256,7 @@ void jhcTofCam::depth_step ()
 
   // record current sensor resolution
   unit = pend;
+  jump = 1;
 }
 
 
@@ -610,7 +1272,7 @@ const unsigned char *jhcTofCam::Night (int sh)
 {
   int i, v, dn = sh + 2;
   unsigned char *d = nite;
-  const unsigned short *s = (unsigned short *) lock;                
+  const unsigned short *s = (unsigned short *) Last();
 
   if (s == NULL)                       // from Range(1)
     return NULL;
@@ -622,3 +1284,202 @@ const unsigned char *jhcTofCam::Night (int sh)
   }
   return nite;
 }
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                          Precise Static Capture                         //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Collect "n" frames (3-255) and compute per-pixel robust average depth.
+// drops "trim" percent of samples at each end (50 gives median)
+// auto-ranging is frozen and all frames use the same depth step
+// uses raw (not median filtered) pixels so no edge blurring occurs
+// work is done incrementally by background thread as frames arrive
+// if "block" <= 0 returns immediately (check PreciseReady later)
+// returns 1 if done, 0 if still running or timeout, negative for error
+
+int jhcTofCam::Precise (int n, int trim, int block)
+{
+  int wait = 0;
+
+  // make sure sensor running and buffers exist
+  if (ok <= 0)
+    return -1;
+  if (chist == NULL)
+    chist = new unsigned char [360000];
+
+  // request capture (background thread may be mid-capture)
+  pthread_mutex_lock(&data);
+  cn = ((n <= 3) ? 3 : ((n < 255) ? n : 255));
+  ctrim = ((trim <= 0) ? 0 : ((trim < 50) ? trim : 50));
+  cstate = 1;
+  pthread_mutex_unlock(&data);
+  if (block <= 0)
+    return 0;
+
+  // wait for completion (allow for pending range change)
+  while (PreciseReady() <= 0)
+  {
+    if (ok <= 0)
+      return -1;
+    if (wait++ > 100 * cn + 2000)      // about 1.5x nominal
+      return 0;
+    usleep(1000);                      // 1 ms loop
+  }
+  return 1;
+}
+
+
+//= Check whether last requested precise capture has finished.
+// state is changed by background thread so read under lock
+
+int jhcTofCam::PreciseReady ()
+{
+  int st;
+
+  pthread_mutex_lock(&data);
+  st = cstate;
+  pthread_mutex_unlock(&data);
+  return((st >= 3) ? 1 : 0);
+}
+
+
+//= Add current raw frame to precise capture (if requested).
+// first 3 frames are saved to pick a per-pixel center (median)
+// afterwards each pixel histograms values within +/-16 of its center
+
+void jhcTofCam::cap_frame ()
+{
+  unsigned char *f3 = chist, *c = chist + 30000;
+  int i, a, b, m, lo, hi, run, n;
+
+  // possibly wait for pending range change then freeze step
+  pthread_mutex_lock(&data);
+  if ((cstate == 1) && (pend == unit))
+  {
+    cunit = unit;
+    ci = 0;
+    cstate = 2;
+  }
+  else if ((cstate == 2) && (unit != cunit))   // should not happen
+  {
+    cunit = unit;
+    ci = 0;
+  }
+  run = cstate;
+  n = cn;
+  pthread_mutex_unlock(&data);
+  if (run != 2)
+    return;
+
+  // normal histogramming
+  if (ci >= 3)
+    cap_bin(raw);
+  else
+  {
+    // save early frames until center can be determined
+    memcpy(f3 + 10000 * ci, raw, 10000);
+    if (ci == 2)
+    {
+      for (i = 0; i < 10000; i++)
+      {
+        a = f3[i];
+        b = f3[i + 10000];
+        m = f3[i + 20000];
+        lo = ((a < b) ? a : b);
+        hi = ((a < b) ? b : a);
+        c[i] = (unsigned char)((m <= lo) ? lo : ((m < hi) ? m : hi));
+      }
+      memset(chist + 40000, 0, 320000);
+      cap_bin(f3);
+      cap_bin(f3 + 10000);
+      cap_bin(f3 + 20000);
+    }
+  }
+
+  // see if enough frames collected
+  if (++ci >= n)
+  {
+    cap_finish();
+    pthread_mutex_lock(&data);
+    if (cstate == 2)                   // not re-requested meanwhile
+      cstate = 3;
+    pthread_mutex_unlock(&data);
+  }
+}
+
+
+//= Add a raw image to the per-pixel 32 bin histograms around centers.
+// values outside the window or saturated are ignored as outliers
+
+void jhcTofCam::cap_bin (const unsigned char *src)
+{
+  unsigned char *h = chist + 40000;
+  const unsigned char *c = chist + 30000, *s = src;
+  int i, off;
+
+  for (i = 10000; i > 0; i--, s++, c++, h += 32)
+    if (*s < 255)
+    {
+      off = *s - *c + 16;
+      if ((off >= 0) && (off < 32))
+        h[off] += 1;
+    }
+}
+
+
+//= Compute trimmed mean and standard deviation for every pixel.
+// deviation is for all samples within histogram window (not trimmed)
+// both results are 16 bit in 0.25mm units, 65535 if too few samples
+
+void jhcTofCam::cap_finish ()
+{
+  double sc = 4.0 * cunit, sum, sum2, ksum, m, dev;
+  const unsigned char *h = chist + 40000, *c = chist + 30000;
+  int i, b, tot, lo, hi, r, n, kn;
+
+  for (i = 0; i < 10000; i++, h += 32, c++)
+  {
+    // get total count and simple statistics
+    tot = 0;
+    sum = 0.0;
+    sum2 = 0.0;
+    for (b = 0; b < 32; b++)
+    {
+      tot += h[b];
+      sum += h[b] * b;
+      sum2 += h[b] * b * b;
+    }
+    if (tot < ((cn + 1) >> 1))
+    {
+      cdep[i] = 65535;
+      cdev[i] = 65535;
+      continue;
+    }
+
+    // keep samples with ranks between lo and hi 
+    lo = (ctrim * tot) / 100;
+    lo = ((lo < ((tot - 1) >> 1)) ? lo : ((tot - 1) >> 1));
+    hi = tot - lo;
+    ksum = 0.0;
+    kn = 0;
+    for (r = 0, b = 0; b < 32; r += h[b], b++)
+    {
+      n = ((r + h[b] < hi) ? r + h[b] : hi) - ((r > lo) ? r : lo);
+      if (n > 0)
+      {
+        ksum += n * b;
+        kn += n;
+      }
+    }
+
+    // convert to 16 bit depth values
+    m = *c - 16.0 + ksum / kn;
+    m = sc * m + 0.5;
+    cdep[i] = (unsigned short)((m < 65534.0) ? m : 65534.0);
+    m = sum / tot;
+    dev = sum2 / tot - m * m;
+    dev = sc * sqrt((dev > 0.0) ? dev : 0.0) + 0.5;
+    cdev[i] = (unsigned short)((dev < 65534.0) ? dev : 65534.0);
+  }
+}
@@ -0,0 +1,117 @@
+// jhcTofClock.cpp : estimates true sensor frame times from jittery arrivals
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+
+#include <jhcTofClock.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofClock::jhcTofClock ()
+{
+  fade = 0.99f;                        // about 7 sec memory
+  rst  = 500.0f;                       // gross error (ms)
+  fmax = 30;                           // max frames skipped
+  Reset();
+}
+
+
+//= Forget all previous observations.
+
+void jhcTofClock::Reset ()
+{
+  sw = 0.0;
+  sn = 0.0;
+  st = 0.0;
+  snn = 0.0;
+  snt = 0.0;
+  stt = 0.0;
+  t0 = 0;
+  last = 0;
+  cnt = 0;
+  per = 1000.0 / 14.8;                 // nominal frame rate
+  err = per;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Add packet "arrive" time (ns) for header "id" (12 bits) and fit line.
+// shifts sums so newest sample is at frame 0 and time 0 (ms)
+// returns estimated true arrival time (ns) for this frame
+
+long long jhcTofClock::Update (long long arrive, int id)
+{
+  double dt, mn, mt, cnn, cnt2, ctt, res, fit;
+  int d;
+
+  // start over if first frame, sensor restarted, or long stall
+  d = (id - last) & 0x0FFF;
+  dt = 1.0e-6 * (arrive - t0);
+  if ((cnt > 0) && ((d <= 0) || (d > fmax) || (dt < 0.0) ||
+                    (fabs(dt - d * per) > rst)))
+    Reset();
+  last = id;
+  if (cnt++ <= 0)
+  {
+    t0 = arrive;
+    sw = 1.0;
+    return arrive;
+  }
+
+  // re-center all old samples on new one then age them
+  snn = fade * (snn - 2.0 * d * sn + d * d * sw);
+  snt = fade * (snt - d * st - dt * sn + d * dt * sw);
+  stt = fade * (stt - 2.0 * dt * st + dt * dt * sw);
+  sn  = fade * (sn - d * sw);
+  st  = fade * (st - dt * sw);
+  sw  = fade * sw + 1.0;               // new sample at (0, 0)
+  t0 = arrive;
+
+  // need a few points for a reasonable line
+  if (cnt < 3)
+    return arrive;
+
+  // solve for slope (period) and value at newest frame
+  mn = sn / sw;
+  mt = st / sw;
+  cnn  = snn - sn * mn;
+  cnt2 = snt - sn * mt;
+  ctt  = stt - st * mt;
+  if (cnn <= 0.0)
+    return arrive;
+  per = cnt2 / cnn;
+  fit = mt - per * mn;
+
+  // residual spread gives uncertainty of fitted point
+  res = (ctt - per * cnt2) / sw;
+  res = ((res > 0.0) ? res : 0.0);
+  err = sqrt(res * (1.0 / sw + mn * mn / cnn));
+  return(arrive + (long long)(1.0e6 * fit));
+}
@@ -0,0 +1,326 @@
+// jhcTofCloud.cpp : converts TOF depth image into organized 3D point cloud
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <string.h>
+
+#include <jhcTofCloud.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofCloud::jhcTofCloud ()
+{
+  // camera optics (see README)
+  flen = 85.7f;                        // focal length along rows
+  asp = 1.21f;                         // x scale factor for columns
+
+  // camera pose (looking straight ahead from floor)
+  cx = 0.0f;
+  cy = 0.0f;
+  cz = 0.0f;
+  pan = 0.0f;
+  tilt = 0.0f;
+  roll = 0.0f;
+
+  // lookup table and transform
+  build_rays();
+  build_rot();
+
+  // no data yet
+  memset(xyz, 0, sizeof(xyz));
+  memset(wxyz, 0, sizeof(wxyz));
+  memset(pyr, 0xFF, sizeof(pyr));
+  nv = 0;
+}
+
+
+//= Compute ray slopes for every pixel given current intrinsics.
+// columns span 70 degrees and rows 60 degrees (pixels not square)
+
+void jhcTofCloud::build_rays ()
+{
+  float sx = asp / flen, sy = 1.0f / flen;
+  int x, y, i = 0;
+
+  for (y = 0; y < 100; y++)
+    for (x = 0; x < 100; x++, i++)
+    {
+      rx[i] = sx * (x - 49.5f);
+      ry[i] = sy * (y - 49.5f);
+    }
+  f0 = flen;
+  a0 = asp;
+}
+
+
+//= Build rotation taking camera frame vectors to world frame.
+
+void jhcTofCloud::build_rot ()
+{
+  PoseRot(rot, pan, tilt, roll);
+}
+
+
+//= Fill "r" with camera to world rotation for angles (degrees) "p", "t", and "rl".
+// applies roll (about Y), then tilt (about X), then pan (about Z)
+
+void jhcTofCloud::PoseRot (float *r, float p, float t, float rl)
+{
+  float d2r = (float)(M_PI / 180.0);
+  float cp = cosf(d2r * p),  sp = sinf(d2r * p);
+  float ct = cosf(d2r * t),  st = sinf(d2r * t);
+  float cr = cosf(d2r * rl), sr = sinf(d2r * rl);
+  float m[9], q[9];
+
+  // Rx(tilt) * Ry(roll)
+  m[0] = cr;        m[1] = 0.0f; m[2] = sr;
+  m[3] = st * sr;   m[4] = ct;   m[5] = -st * cr;
+  m[6] = -ct * sr;  m[7] = st;   m[8] = ct * cr;
+
+  // Rz(pan) * previous
+  q[0] = cp * m[0] - sp * m[3];
+  q[1] = cp * m[1] - sp * m[4];
+  q[2] = cp * m[2] - sp * m[5];
+  q[3] = sp * m[0] + cp * m[3];
+  q[4] = sp * m[1] + cp * m[4];
+  q[5] = sp * m[2] + cp * m[5];
+  q[6] = m[6];
+  q[7] = m[7];
+  q[8] = m[8];
+
+  // fold in camera axes: X = x, Y = z, Z = -y (permute columns)
+  r[0] = q[0];  r[1] = -q[2];  r[2] = q[1];
+  r[3] = q[3];  r[4] = -q[5];  r[5] = q[4];
+  r[6] = q[6];  r[7] = -q[8];  r[8] = q[7];
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Generate camera and world points from 16 bit image (0.25mm units).
+// takes pointer from jhcTofCam::Range (65535 = invalid pixel)
+// also fills in depth pyramid for coarse-to-fine methods
+// returns number of valid points
+
+int jhcTofCloud::Convert (const unsigned char *range)
+{
+  const unsigned short *d = (const unsigned short *) range;
+  float *p = xyz, *w = wxyz;
+  float z, x, y;
+  int i;
+
+  // make sure lookup tables and transform are current
+  if (range == NULL)
+    return 0;
+  if ((flen != f0) || (asp != a0))
+    build_rays();
+  build_rot();
+
+  // convert each valid pixel
+  nv = 0;
+  for (i = 0; i < 10000; i++, d++, p += 3, w += 3)
+  {
+    pyr[i] = *d;
+    if ((*d == 0) || (*d >= 65535))
+    {
+      p[0] = 0.0f;
+      p[1] = 0.0f;
+      p[2] = 0.0f;
+      w[0] = 0.0f;
+      w[1] = 0.0f;
+      w[2] = 0.0f;
+      continue;
+    }
+    z = 0.25f * (*d);
+    x = z * rx[i];
+    y = z * ry[i];
+    p[0] = x;
+    p[1] = y;
+    p[2] = z;
+    w[0] = rot[0] * x + rot[1] * y + rot[2] * z + cx;
+    w[1] = rot[3] * x + rot[4] * y + rot[5] * z + cy;
+    w[2] = rot[6] * x + rot[7] * y + rot[8] * z + cz;
+    nv++;
+  }
+
+  // build coarser depth images
+  for (i = 1; i < Levels(); i++)
+    shrink(i);
+  return nv;
+}
+
+
+//= Make pyramid level "lvl" from next finer one by averaging valid pixels.
+// odd sized sources duplicate last row and column
+
+void jhcTofCloud::shrink (int lvl)
+{
+  int sw = LvlSide(lvl - 1), dw = LvlSide(lvl), lim = sw - 1;
+  const unsigned short *s = pyr + LvlOff(lvl - 1);
+  unsigned short *d = pyr + LvlOff(lvl);
+  int x, y, i, j, sx, sy, v, sum, n;
+
+  for (y = 0; y < dw; y++)
+    for (x = 0; x < dw; x++, d++)
+    {
+      sum = 0;
+      n = 0;
+      for (j = 0; j < 2; j++)
+      {
+        sy = 2 * y + j;
+        sy = ((sy < lim) ? sy : lim);
+        for (i = 0; i < 2; i++)
+        {
+          sx = 2 * x + i;
+          sx = ((sx < lim) ? sx : lim);
+          v = s[sy * sw + sx];
+          if ((v > 0) && (v < 65535))
+          {
+            sum += v;
+            n++;
+          }
+        }
+      }
+      *d = (unsigned short)((n > 0) ? (sum + (n >> 1)) / n : 65535);
+    }
+}
+
+
+//= Convert a camera frame point to world frame.
+
+void jhcTofCloud::ToWorld (float& wx, float& wy, float& wz, float x, float y, float z) const
+{
+  wx = rot[0] * x + rot[1] * y + rot[2] * z + cx;
+  wy = rot[3] * x + rot[4] * y + rot[5] * z + cy;
+  wz = rot[6] * x + rot[7] * y + rot[8] * z + cz;
+}
+
+
+//= Convert a world frame point to camera frame (uses last pose converted).
+
+void jhcTofCloud::ToCam (float& x, float& y, float& z, float wx, float wy, float wz) const
+{
+  float dx = wx - cx, dy = wy - cy, dz = wz - cz;
+
+  x = rot[0] * dx + rot[3] * dy + rot[6] * dz;
+  y = rot[1] * dx + rot[4] * dy + rot[7] * dz;
+  z = rot[2] * dx + rot[5] * dy + rot[8] * dz;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                             Plane Fitting                             //
+///////////////////////////////////////////////////////////////////////////
+
+//= Add point to moment sums (count, x, y, z, xx, xy, xz, yy, yz, zz).
+
+void jhcTofCloud::AddMoments (double *m, const float *p)
+{
+  double x = p[0], y = p[1], z = p[2];
+
+  m[0] += 1.0;
+  m[1] += x;
+  m[2] += y;
+  m[3] += z;
+  m[4] += x * x;
+  m[5] += x * y;
+  m[6] += x * z;
+  m[7] += y * y;
+  m[8] += y * z;
+  m[9] += z * z;
+}
+
+
+//= Least squares plane for moment sums, oriented so camera is on positive side.
+// normal is direction of least scatter (uses largest 2x2 cofactor)
+// returns rms distance of points from plane, negative if degenerate
+
+float jhcTofCloud::FitPlane (float *n, float& d, const double *m)
+{
+  double mx, my, mz, xx, xy, xz, yy, yz, zz, dx, dy, dz, nx, ny, nz, len, v;
+  double cnt = m[0];
+
+  // covariance about centroid
+  if (cnt < 3.0)
+    return -1.0f;
+  mx = m[1] / cnt;
+  my = m[2] / cnt;
+  mz = m[3] / cnt;
+  xx = m[4] / cnt - mx * mx;
+  xy = m[5] / cnt - mx * my;
+  xz = m[6] / cnt - mx * mz;
+  yy = m[7] / cnt - my * my;
+  yz = m[8] / cnt - my * mz;
+  zz = m[9] / cnt - mz * mz;
+
+  // solve for normal using best conditioned pair of axes
+  dx = yy * zz - yz * yz;
+  dy = xx * zz - xz * xz;
+  dz = xx * yy - xy * xy;
+  if ((dx >= dy) && (dx >= dz))
+  {
+    nx = dx;
+    ny = xz * yz - xy * zz;
+    nz = xy * yz - xz * yy;
+  }
+  else if (dy >= dz)
+  {
+    nx = xz * yz - xy * zz;
+    ny = dy;
+    nz = xy * xz - yz * xx;
+  }
+  else
+  {
+    nx = xy * yz - xz * yy;
+    ny = xy * xz - yz * xx;
+    nz = dz;
+  }
+  if ((len = sqrt(nx * nx + ny * ny + nz * nz)) <= 0.0)
+    return -1.0f;
+  nx /= len;
+  ny /= len;
+  nz /= len;
+
+  // save unit normal and offset (camera on positive side)
+  d = -(float)(nx * mx + ny * my + nz * mz);
+  if (d < 0.0f)
+  {
+    nx = -nx;
+    ny = -ny;
+    nz = -nz;
+    d = -d;
+  }
+  n[0] = (float) nx;
+  n[1] = (float) ny;
+  n[2] = (float) nz;
+
+  // variance along normal direction
+  v = nx * (nx * xx + 2.0 * (ny * xy + nz * xz)) + ny * (ny * yy + 2.0 * nz * yz) + nz * nz * zz;
+  return((v > 0.0) ? (float) sqrt(v) : 0.0f);
+}
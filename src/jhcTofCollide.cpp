@@ -0,0 +1,286 @@
+// jhcTofCollide.cpp : conservative sphere and capsule checks against depth image
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <string.h>
+
+#include <jhcTofCollide.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofCollide::jhcTofCollide ()
+{
+  margin = 10.0f;                      // required clearance (mm)
+  unk = 1;                             // unknown space is occupied
+  memset(mpyr, 0, sizeof(mpyr));
+  sx = 1.0f;
+  sy = 1.0f;
+  ok = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Take snapshot of depth image and camera model to use for queries.
+// "range" is 16 bit Range image, pose and optics come from "cloud"
+// returns 1 if okay, 0 if no image
+
+int jhcTofCollide::Pin (const unsigned char *range, const jhcTofCloud& cloud)
+{
+  const unsigned short *d = (const unsigned short *) range;
+  unsigned short bad = (unsigned short)((unk > 0) ? 0 : 65535);
+  int i, lvl;
+
+  // copy depths with invalid pixels marked as near or far
+  ok = 0;
+  if (range == NULL)
+    return 0;
+  for (i = 0; i < 10000; i++, d++)
+    mpyr[i] = (((*d == 0) || (*d == 65535)) ? bad : *d);
+  for (lvl = 1; lvl < Levels(); lvl++)
+    shrink(lvl);
+
+  // copy camera model
+  sx = cloud.asp / cloud.flen;
+  sy = 1.0f / cloud.flen;
+  memcpy(rot, cloud.Rot(), sizeof(rot));
+  pos[0] = cloud.cx;
+  pos[1] = cloud.cy;
+  pos[2] = cloud.cz;
+  ok = 1;
+  return 1;
+}
+
+
+//= Make pyramid level "lvl" as minimum over 2x2 blocks of next finer level.
+// odd sized sources duplicate last row and column
+
+void jhcTofCollide::shrink (int lvl)
+{
+  int sw = LvlSide(lvl - 1), dw = LvlSide(lvl), lim = sw - 1;
+  const unsigned short *s = mpyr + LvlOff(lvl - 1);
+  unsigned short *d = mpyr + LvlOff(lvl);
+  int x, y, sx0, sx1, sy0, sy1, v;
+
+  for (y = 0; y < dw; y++)
+  {
+    sy0 = sw * (y << 1);
+    sy1 = sw * (((y << 1) < lim) ? (y << 1) + 1 : lim);
+    for (x = 0; x < dw; x++, d++)
+    {
+      sx0 = x << 1;
+      sx1 = ((sx0 < lim) ? sx0 + 1 : lim);
+      v = s[sy0 + sx0];
+      v = ((s[sy0 + sx1] < v) ? s[sy0 + sx1] : v);
+      v = ((s[sy1 + sx0] < v) ? s[sy1 + sx0] : v);
+      v = ((s[sy1 + sx1] < v) ? s[sy1 + sx1] : v);
+      *d = (unsigned short) v;
+    }
+  }
+}
+
+
+//= Check whether sphere at "x", "y", "z" with radius "r" might hit something.
+// coordinates are camera frame (world = 0) or world frame of pinned pose (mm)
+// returns 1 if possible collision, 0 if definitely free
+
+int jhcTofCollide::Sphere (float x, float y, float z, float r, int world) const
+{
+  float c[3], dx, dy, dz;
+
+  if (ok <= 0)
+    return 1;
+  if (world <= 0)
+  {
+    c[0] = x;
+    c[1] = y;
+    c[2] = z;
+  }
+  else
+  {
+    // inverse of camera to world transform
+    dx = x - pos[0];
+    dy = y - pos[1];
+    dz = z - pos[2];
+    c[0] = rot[0] * dx + rot[3] * dy + rot[6] * dz;
+    c[1] = rot[1] * dx + rot[4] * dy + rot[7] * dz;
+    c[2] = rot[2] * dx + rot[5] * dy + rot[8] * dz;
+  }
+  return cam_sphere(c, r);
+}
+
+
+//= Check "n" spheres given as x, y, z, radius quadruples in "xyzr".
+// sets each "hit" entry to 1 if possible collision (unless NULL)
+// returns number of spheres that might collide
+
+int jhcTofCollide::Spheres (unsigned char *hit, const float *xyzr, int n, int world) const
+{
+  const float *s = xyzr;
+  int i, h, cnt = 0;
+
+  for (i = 0; i < n; i++, s += 4)
+  {
+    h = Sphere(s[0], s[1], s[2], s[3], world);
+    if (hit != NULL)
+      hit[i] = (unsigned char) h;
+    cnt += h;
+  }
+  return cnt;
+}
+
+
+//= Check "n" capsules given as end a (x, y, z), end b (x, y, z), and radius.
+// each is covered by spheres no more than radius apart along its axis
+// sets each "hit" entry to 1 if possible collision (unless NULL)
+// returns number of capsules that might collide
+
+int jhcTofCollide::Capsules (unsigned char *hit, const float *abr, int n, int world) const
+{
+  const float *s = abr;
+  float dx, dy, dz, len, step, r2, f;
+  int i, j, ns, h, cnt = 0;
+
+  for (i = 0; i < n; i++, s += 7)
+  {
+    // spacing and enlarged radius to cover gaps between spheres
+    dx = s[3] - s[0];
+    dy = s[4] - s[1];
+    dz = s[5] - s[2];
+    len = sqrtf(dx * dx + dy * dy + dz * dz);
+    ns = ((s[6] > 0.0f) ? (int) ceilf(len / s[6]) : 0);
+    step = ((ns > 0) ? len / ns : 0.0f);
+    r2 = sqrtf(s[6] * s[6] + 0.25f * step * step);
+
+    // stop at first possible collision
+    h = 0;
+    for (j = 0; (j <= ns) && (h <= 0); j++)
+    {
+      f = ((ns > 0) ? j / (float) ns : 0.0f);
+      h = Sphere(s[0] + f * dx, s[1] + f * dy, s[2] + f * dz, r2, world);
+    }
+    if (hit != NULL)
+      hit[i] = (unsigned char) h;
+    cnt += h;
+  }
+  return cnt;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                            Sphere Testing                             //
+///////////////////////////////////////////////////////////////////////////
+
+//= Test camera frame sphere at "c" with radius "r" against pinned depths.
+// returns 1 if possible collision, 0 if definitely free
+
+int jhcTofCollide::cam_sphere (const float *c, float r) const
+{
+  float xlo, xhi, ylo, yhi;
+  int x0, x1, y0, y1, lim, lvl = 0;
+
+  // spheres enclosing camera have no finite image footprint
+  if ((tangents(xlo, xhi, c[0], c[2], r) <= 0) ||
+      (tangents(ylo, yhi, c[1], c[2], r) <= 0))
+    return 1;
+
+  // convert ray slopes to pixel ranges
+  x0 = (int) floorf(xlo / sx + 50.0f);
+  x1 = (int) floorf(xhi / sx + 50.0f);
+  y0 = (int) floorf(ylo / sy + 50.0f);
+  y1 = (int) floorf(yhi / sy + 50.0f);
+  if ((x1 < 0) || (x0 > 99) || (y1 < 0) || (y0 > 99))
+    return unk;
+  if ((x0 < 0) || (x1 > 99) || (y0 < 0) || (y1 > 99))
+  {
+    if (unk > 0)
+      return 1;
+    x0 = ((x0 > 0) ? x0 : 0);
+    x1 = ((x1 < 99) ? x1 : 99);
+    y0 = ((y0 > 0) ? y0 : 0);
+    y1 = ((y1 < 99) ? y1 : 99);
+  }
+
+  // surfaces must all be beyond far side of sphere
+  lim = (int) ceilf(4.0f * (c[2] + r + margin));
+  if (lim >= 65535)
+    return 1;
+
+  // start at level where footprint spans at most 2 x 2 cells
+  while (((x1 >> lvl) - (x0 >> lvl) > 1) || ((y1 >> lvl) - (y0 >> lvl) > 1))
+    lvl++;
+  return occupied(lvl, x0, x1, y0, y1, lim);
+}
+
+
+//= Get range of slopes a/z of rays tangent to circle at "a", "z" with radius "r".
+// returns 1 if okay, 0 if circle contains origin or is behind it
+
+int jhcTofCollide::tangents (float& lo, float& hi, float a, float z, float r) const
+{
+  float den = z * z - r * r, q;
+
+  if ((z <= r) || (den <= 0.0f))
+    return 0;
+  q = r * sqrtf(a * a + den);
+  lo = (a * z - q) / den;
+  hi = (a * z + q) / den;
+  return 1;
+}
+
+
+//= See if any cell covering pixel box has a surface at depth "lim" or closer.
+// only cells failing the test at one level are examined at the next finer
+// returns 1 if some full resolution pixel fails, 0 if all are beyond
+
+int jhcTofCollide::occupied (int lvl, int x0, int x1, int y0, int y1, int lim) const
+{
+  const unsigned short *m = mpyr + LvlOff(lvl);
+  int side = LvlSide(lvl), last = (1 << lvl) - 1;
+  int cx, cy, px0, px1, py0, py1;
+
+  for (cy = (y0 >> lvl); cy <= (y1 >> lvl); cy++)
+    for (cx = (x0 >> lvl); cx <= (x1 >> lvl); cx++)
+    {
+      if (m[cy * side + cx] > lim)
+        continue;
+      if (lvl <= 0)
+        return 1;
+
+      // look at finer cells under this one (clipped to box)
+      px0 = cx << lvl;
+      px1 = px0 + last;
+      py0 = cy << lvl;
+      py1 = py0 + last;
+      if (occupied(lvl - 1, ((x0 > px0) ? x0 : px0), ((x1 < px1) ? x1 : px1),
+                            ((y0 > py0) ? y0 : py0), ((y1 < py1) ? y1 : py1), lim) > 0)
+        return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,404 @@
+// jhcTofFlow.cpp : dense 3D scene flow between consecutive TOF frames
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include <jhcTofFlow.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofFlow::jhcTofFlow ()
+{
+  int i;
+
+  // matching parameters
+  dmax = 150;                          // max depth change (mm/frame)
+  sm = 12;                             // cost per pixel from prediction
+  zm = 1;                              // cost per 4mm of depth change
+  tex = 12;                            // min cost spread for texture
+  ds = 25;                             // max neighbor step (mm) in surface
+
+  // reciprocals for averaging blocks
+  for (i = 1; i <= 9; i++)
+    inv[i] = 65536 / i;
+  inv[0] = 0;
+
+  // no history yet
+  memset(hit, 0, sizeof(hit));
+  memset(fxyz, 0, sizeof(fxyz));
+  nm = 0;
+  nf = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Find motion of each pixel in previous frame to its place in "now".
+// uses depth pyramid and points already computed by jhcTofCloud
+// search is +/-2 pixels at coarsest level then +/-1 for each finer
+// returns number of pixels with valid flow (0 on first call)
+
+int jhcTofFlow::Analyze (const jhcTofCloud& now)
+{
+  int lvl, top = jhcTofCloud::Levels() - 1, sz = 2 * jhcTofCloud::PyrSize();
+
+  // need a previous frame
+  nm = 0;
+  if (nf++ <= 0)
+  {
+    memcpy(last, now.Depth(0), sz);
+    memset(hit, 0, sizeof(hit));
+    memset(fxyz, 0, sizeof(fxyz));
+    return 0;
+  }
+
+  // refine displacements from coarse to fine (only confident ones passed)
+  for (lvl = top; lvl >= 0; lvl--)
+  {
+    if (lvl < top)
+    {
+      memcpy(cu, du, sizeof(cu));
+      memcpy(cv, dv, sizeof(cv));
+      memcpy(chit, hit, sizeof(chit));
+      memcpy(camb, amb, sizeof(camb));
+    }
+    match_lvl(lvl, now.Depth(0), ((lvl >= top) ? 2 : 1));
+  }
+
+  // fill in featureless areas then get 3D vectors then remember current depths
+  propagate();
+  vectors(now);
+  memcpy(last, now.Depth(0), sz);
+  return nm;
+}
+
+
+//= Match each valid pixel at some pyramid level using 3x3 blocks.
+// cost is offset-free SAD plus penalties for deviating from coarser
+// estimate and for large depth changes (integer arithmetic throughout)
+// marks pixel as ambiguous if all shifts give about the same SAD,
+// if the best SAD is poor (occluded), or if background at a depth edge
+
+void jhcTofFlow::match_lvl (int lvl, const unsigned short *d1, int rng)
+{
+  int w = jhcTofCloud::LvlSide(lvl), cw = jhcTofCloud::LvlSide(lvl + 1);
+  int top = (lvl >= jhcTofCloud::Levels() - 1), lim = 4 * dmax, tol = 4 * ds;
+  const unsigned short *a = last + jhcTofCloud::LvlOff(lvl);
+  const unsigned short *b = d1 + jhcTofCloud::LvlOff(lvl);
+  const unsigned short *ca = last + jhcTofCloud::LvlOff(lvl + 1);
+  int x, y, p, c, u, v, pu, pv, m, sc, cost, best, bu, bv, lo, hi;
+  int noise, n = 0, sum = 0;
+
+  for (y = 0, p = 0; y < w; y++)
+    for (x = 0; x < w; x++, p++)
+    {
+      // only track valid pixels
+      du[p] = 0;
+      dv[p] = 0;
+      hit[p] = 0;
+      amb[p] = 0;
+      if ((a[p] == 0) || (a[p] >= 65535))
+        continue;
+
+      // get predicted displacement from coarser level
+      pu = 0;
+      pv = 0;
+      if (!top && ((c = parent(ca, cw, x, y, a[p])) >= 0))
+      {
+        pu = 2 * cu[c];
+        pv = 2 * cv[c];
+      }
+
+      // try all displacements near prediction
+      best = -1;
+      bu = 0;
+      bv = 0;
+      lo = -1;
+      hi = -1;
+      for (v = pv - rng; v <= pv + rng; v++)
+        for (u = pu - rng; u <= pu + rng; u++)
+        {
+          // get shape mismatch and average depth change
+          if ((sc = block_cost(m, a, b, w, x, y, u, v)) < 0)
+            continue;
+          if ((m > lim) || (m < -lim))
+            continue;
+          lo = (((lo < 0) || (sc < lo)) ? sc : lo);
+          hi = ((sc > hi) ? sc : hi);
+
+          // add penalties for unlikely motions
+          cost = sc + sm * (((u >= pu) ? u - pu : pu - u) + ((v >= pv) ? v - pv : pv - v));
+          cost += (zm * ((m >= 0) ? m : -m)) >> 4;
+          if ((best < 0) || (cost < best))
+          {
+            best = cost;
+            bu = u;
+            bv = v;
+          }
+        }
+
+      // save best displacement (if any) and match quality
+      if (best >= 0)
+      {
+        du[p] = (short) bu;
+        dv[p] = (short) bv;
+        hit[p] = 1;
+        fit[p] = (short) lo;
+        spr[p] = (short)((behind(a, w, x, y, tol) > 0) ? 0 : hi - lo);
+        sum += lo;
+        n++;
+      }
+    }
+
+  // judge matches relative to typical mismatch (noise) at this level
+  if (n <= 0)
+    return;
+  noise = sum / n;
+  for (p = w * w - 1; p >= 0; p--)
+    if (hit[p] > 0)
+      if ((4 * spr[p] < noise + 4 * tex) || (fit[p] > 3 * noise + tex))
+        amb[p] = 1;
+}
+
+
+//= Pick coarser level pixel to supply displacement prediction for (x, y).
+// considers 3x3 coarse neighbors and takes one with most similar depth
+// keeps motion of occluding edges from leaking onto background surfaces
+// returns index at coarser level, negative if no confident match there
+
+int jhcTofFlow::parent (const unsigned short *ca, int cw, int x, int y, int d) const
+{
+  int i, j, cx, cy, c, dz, best = -1, win = -1;
+
+  for (j = -1; j <= 1; j++)
+  {
+    cy = (y >> 1) + j;
+    if ((cy < 0) || (cy >= cw))
+      continue;
+    for (i = -1; i <= 1; i++)
+    {
+      cx = (x >> 1) + i;
+      if ((cx < 0) || (cx >= cw))
+        continue;
+      c = cy * cw + cx;
+      if ((chit[c] <= 0) || (camb[c] > 0))
+        continue;
+      dz = ((ca[c] >= d) ? ca[c] - d : d - ca[c]);
+      if ((best < 0) || (dz < best))
+      {
+        best = dz;
+        win = c;
+      }
+    }
+  }
+  return win;
+}
+
+
+//= Check if pixel (x, y) is on far side of a depth edge.
+// motion of an edge belongs to the nearer (occluding) surface
+// returns 1 if some 8-neighbor is closer by more than "tol"
+
+int jhcTofFlow::behind (const unsigned short *a, int w, int x, int y, int tol) const
+{
+  int i, j, v, lim = a[y * w + x] - tol;
+
+  for (j = -1; j <= 1; j++)
+    if ((y + j >= 0) && (y + j < w))
+      for (i = -1; i <= 1; i++)
+        if ((x + i >= 0) && (x + i < w))
+        {
+          v = a[(y + j) * w + x + i];
+          if ((v > 0) && (v < lim))
+            return 1;
+        }
+  return 0;
+}
+
+
+//= Compare 3x3 block around (x, y) in "a" to one shifted by (u, v) in "b".
+// sets "m" to average depth difference (0.25mm units)
+// returns 8x mean absolute deviation from "m", negative if too few pixels
+
+int jhcTofFlow::block_cost (int& m, const unsigned short *a, const unsigned short *b, 
+                            int w, int x, int y, int u, int v) const
+{
+  const unsigned short *pa, *pb;
+  int e[9];
+  int i, j, xa, ya, xb = x + u, yb = y + v, n = 0, sum = 0, sad = 0;
+
+  // center must land inside image 
+  if ((xb < 0) || (xb >= w) || (yb < 0) || (yb >= w))
+    return -1;
+
+  // collect depth differences over block (fast if no edges)
+  if ((x > 0) && (x < w - 1) && (y > 0) && (y < w - 1) &&
+      (xb > 0) && (xb < w - 1) && (yb > 0) && (yb < w - 1))
+  {
+    pa = a + (y - 1) * w + x - 1;
+    pb = b + (yb - 1) * w + xb - 1;
+    for (j = 0; j < 3; j++, pa += w, pb += w)
+      for (i = 0; i < 3; i++)
+        if (((pa[i] - 1U) < 65534U) && ((pb[i] - 1U) < 65534U))
+        {
+          e[n] = pb[i] - pa[i];
+          sum += e[n++];
+        }
+  }
+  else
+    for (j = -1; j <= 1; j++)
+    {
+      ya = y + j;
+      if ((ya < 0) || (ya >= w) || (ya + v < 0) || (ya + v >= w))
+        continue;
+      pa = a + ya * w;
+      pb = b + (ya + v) * w + u;
+      for (i = -1; i <= 1; i++)
+      {
+        xa = x + i;
+        if ((xa < 0) || (xa >= w) || (xa + u < 0) || (xa + u >= w))
+          continue;
+        if (((pa[xa] - 1U) < 65534U) && ((pb[xa] - 1U) < 65534U))
+        {
+          e[n] = pb[xa] - pa[xa];
+          sum += e[n++];
+        }
+      }
+    }
+  if (n < 5)
+    return -1;
+
+  // remove average depth change then score shape mismatch
+  m = (sum * inv[n] + 32768) >> 16;
+  for (i = 0; i < n; i++)
+    sad += ((e[i] >= m) ? e[i] - m : m - e[i]);
+  return((sad * inv[n]) >> 13);
+}
+
+
+//= Fill in ambiguous full resolution pixels from neighbors on same surface.
+// forward then backward raster scan spreads motion across whole regions
+// pixels with no informative neighbors keep their coarser prediction
+// only done at finest level since coarse pixels can straddle depth edges
+
+void jhcTofFlow::propagate ()
+{
+  int w = jhcTofCloud::LvlSide(0), n = w * w, tol = 4 * ds;
+  const unsigned short *a = last;
+  int p;
+
+  for (p = 0; p < n; p++)
+    if (amb[p] > 0)
+      nbr_avg(p, w, tol, a);
+  for (p = n - 1; p >= 0; p--)
+    if (amb[p] > 0)
+      nbr_avg(p, w, tol, a);
+}
+
+
+//= Set displacement of pixel "p" to average of informed 8-neighbors.
+// neighbors must have depth within "tol" (0.25mm) of center
+// returns 1 if changed, 0 if no suitable neighbors
+
+int jhcTofFlow::nbr_avg (int p, int w, int tol, const unsigned short *a)
+{
+  int x = p % w, y = p / w;
+  int i, j, q, n = 0, su = 0, sv = 0, ref = a[p], dz;
+
+  for (j = -1; j <= 1; j++)
+  {
+    if ((y + j < 0) || (y + j >= w))
+      continue;
+    for (i = -1; i <= 1; i++)
+    {
+      if ((x + i < 0) || (x + i >= w) || ((i == 0) && (j == 0)))
+        continue;
+      q = p + j * w + i;
+      if ((hit[q] <= 0) || (amb[q] == 1))
+        continue;
+      dz = a[q] - ref;
+      if ((dz > tol) || (dz < -tol))
+        continue;
+      su += du[q];
+      sv += dv[q];
+      n++;
+    }
+  }
+  if (n <= 0)
+    return 0;
+  du[p] = (short)(((su >= 0) ? su + (n >> 1) : su - (n >> 1)) / n);
+  dv[p] = (short)(((sv >= 0) ? sv + (n >> 1) : sv - (n >> 1)) / n);
+  amb[p] = 2;                          // now informed
+  return 1;
+}
+
+
+//= Convert full resolution displacements into 3D camera frame vectors.
+// previous point is rebuilt from saved depth and ray, new one from cloud
+
+void jhcTofFlow::vectors (const jhcTofCloud& now)
+{
+  const float *pts = now.Cam();
+  short *f = fxyz;
+  float z0, v;
+  int i, q, k, mx, my;
+
+  for (i = 0; i < 10000; i++, f += 3)
+  {
+    // find matching point in current frame (averaged shifts may leave image)
+    f[0] = 0;
+    f[1] = 0;
+    f[2] = 0;
+    if (hit[i] <= 0)
+      continue;
+    mx = (i % 100) + du[i];
+    my = (i / 100) + dv[i];
+    if ((mx < 0) || (mx > 99) || (my < 0) || (my > 99))
+    {
+      hit[i] = 0;
+      continue;
+    }
+    q = 3 * (100 * my + mx);
+    if (pts[q + 2] <= 0.0f)
+    {
+      hit[i] = 0;
+      continue;
+    }
+
+    // difference from old point (mm)
+    z0 = 0.25f * last[i];
+    for (k = 0; k < 3; k++)
+    {
+      v = pts[q + k] - ((k == 0) ? z0 * now.RayX(i) : ((k == 1) ? z0 * now.RayY(i) : z0));
+      v = ((v <= -32767.0f) ? -32767.0f : ((v < 32767.0f) ? v : 32767.0f));
+      f[k] = (short)((v >= 0.0f) ? v + 0.5f : v - 0.5f);
+    }
+    nm++;
+  }
+}
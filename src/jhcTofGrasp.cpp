@@ -0,0 +1,231 @@
+// jhcTofGrasp.cpp : proposes top-down grasps for objects found on support plane
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+
+#include <jhcTofGrasp.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofGrasp::jhcTofGrasp ()
+{
+  // gripper geometry
+  open = 80.0f;                        // max jaw opening (mm)
+  fthick = 15.0f;                      // finger thickness (mm)
+  fwid = 20.0f;                        // finger width (mm)
+  margin = 10.0f;                      // extra opening each side (mm)
+
+  // grasp height
+  tfrac = 0.7f;                        // top surface part of max height
+
+  // no grasps yet
+  ax[0] = 0.0f;
+  ax[1] = 1.0f;
+  ax[2] = 0.0f;
+  ng = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Find up to two grasps for each object from last call to objs.Analyze.
+// one closes across the narrow axis, the other across the long axis
+// grasps needing more than the max jaw opening are not proposed
+// returns total number of grasps found
+
+int jhcTofGrasp::Analyze (const jhcTofObjs& objs, const jhcTofCloud& cloud)
+{
+  int k, n = objs.Count();
+
+  ng = 0;
+  if ((objs.Plane() <= 0) || (n <= 0))
+    return 0;
+  plane_axes(objs);
+  objs.Extents(ctr, maj, size, ux, vx, cloud);
+  footprints(objs, cloud);
+  for (k = 0; k < n; k++)
+  {
+    add_grasp(k, 0, objs, cloud);
+    add_grasp(k, 1, objs, cloud);
+  }
+  return ng;
+}
+
+
+//= Get plane coordinate system with approach direction opposite normal.
+
+void jhcTofGrasp::plane_axes (const jhcTofObjs& objs)
+{
+  const float *n = objs.Normal();
+  int i;
+
+  // plane normal points toward camera so gripper approaches opposite
+  for (i = 0; i < 3; i++)
+  {
+    nx[i] = n[i];
+    ax[i] = -n[i];
+  }
+  d0 = objs.Offset();
+  objs.PlaneAxes(ux, vx);
+}
+
+
+//= Get top height and image bounding box of each object footprint.
+// box is padded by largest gripper reach at average depth
+
+void jhcTofGrasp::footprints (const jhcTofObjs& objs, const jhcTofCloud& cloud)
+{
+  float sh[100], zs[100];
+  int nh[100], np[100];
+  const unsigned short *lab = objs.Labels();
+  const short *hgt = objs.Height();
+  const float *p = cloud.Cam();
+  float reach = 0.5f * open + 2.0f * fthick;
+  int x, y, k, pad, n = objs.Count(), i = 0;
+
+  // clear accumulators
+  for (k = 0; k < n; k++)
+  {
+    sh[k] = 0.0f;
+    zs[k] = 0.0f;
+    nh[k] = 0;
+    np[k] = 0;
+    box[k][0] = 99;
+    box[k][1] = 0;
+    box[k][2] = 99;
+    box[k][3] = 0;
+  }
+
+  // gather top surface heights, depths, and image extent
+  for (y = 0; y < 100; y++)
+    for (x = 0; x < 100; x++, i++, p += 3)
+    {
+      if ((k = lab[i] - 1) < 0)
+        continue;
+      zs[k] += p[2];
+      np[k]++;
+      if (hgt[i] >= tfrac * objs.MaxHt(k + 1))
+      {
+        sh[k] += hgt[i];
+        nh[k]++;
+      }
+      box[k][0] = ((x < box[k][0]) ? x : box[k][0]);
+      box[k][1] = ((x > box[k][1]) ? x : box[k][1]);
+      box[k][2] = ((y < box[k][2]) ? y : box[k][2]);
+      box[k][3] = ((y > box[k][3]) ? y : box[k][3]);
+    }
+
+  // analyze each object
+  for (k = 0; k < n; k++)
+  {
+    top[k] = ((nh[k] > 0) ? sh[k] / nh[k] : objs.MaxHt(k + 1));
+
+    // pad image box by gripper reach at average depth
+    pad = (int)(reach * cloud.flen * np[k] / zs[k]) + 1;
+    box[k][0] = ((box[k][0] > pad) ? box[k][0] - pad : 0);
+    box[k][1] = ((box[k][1] < 99 - pad) ? box[k][1] + pad : 99);
+    box[k][2] = ((box[k][2] > pad) ? box[k][2] - pad : 0);
+    box[k][3] = ((box[k][3] < 99 - pad) ? box[k][3] + pad : 99);
+  }
+}
+
+
+//= Propose grasp for object "k" closing across minor (across = 0) or major axis.
+// skipped if object is too wide for jaws or too many grasps already
+
+void jhcTofGrasp::add_grasp (int k, int across, const jhcTofObjs& objs, const jhcTofCloud& cloud)
+{
+  float g[2], c[2];
+  float *pos, *dir;
+  float w = ((across <= 0) ? size[k][1] : size[k][0]), h = top[k] - d0;
+  int i;
+
+  // check that jaws can span object
+  if ((ng >= 200) || (w + 2.0f * margin > open))
+    return;
+  g[0] = ctr[k][0];
+  g[1] = ctr[k][1];
+  c[0] = ((across <= 0) ? -maj[k][1] : maj[k][0]);
+  c[1] = ((across <= 0) ?  maj[k][0] : maj[k][1]);
+
+  // convert to camera frame
+  pos = gpos[ng];
+  dir = gdir[ng];
+  for (i = 0; i < 3; i++)
+  {
+    pos[i] = g[0] * ux[i] + g[1] * vx[i] + h * nx[i];
+    dir[i] = c[0] * ux[i] + c[1] * vx[i];
+  }
+  gwid[ng] = w;
+  gclr[ng] = clearance(g, c, w, k, objs, cloud);
+  gobj[ng] = k + 1;
+  ng++;
+}
+
+
+//= Free space (mm) outside each jaw along closing direction "c" from "g".
+// looks for pixels of other things taller than hmin in the strip swept by fingers
+// value is capped at twice the finger thickness, 0 means a jaw hits something
+
+float jhcTofGrasp::clearance (const float *g, const float *c, float w, int k,
+                              const jhcTofObjs& objs, const jhcTofCloud& cloud) const
+{
+  const unsigned short *lab = objs.Labels();
+  const short *hgt = objs.Height();
+  const float *pts = cloud.Cam(), *p;
+  float hw = 0.5f * w + margin, fw = 0.5f * fwid, cap = 2.0f * fthick, best = cap;
+  float da, db, sc, so, free;
+  int x, y, i, hlim = (int)(objs.hmin + 0.5f);
+
+  for (y = box[k][2]; y <= box[k][3]; y++)
+    for (x = box[k][0]; x <= box[k][1]; x++)
+    {
+      // only consider tall pixels not part of this object
+      i = 100 * y + x;
+      if ((lab[i] == k + 1) || (hgt[i] < hlim))
+        continue;
+      p = pts + 3 * i;
+      if (p[2] <= 0.0f)
+        continue;
+
+      // see if in strip swept by fingers
+      da = ux[0] * p[0] + ux[1] * p[1] + ux[2] * p[2] - g[0];
+      db = vx[0] * p[0] + vx[1] * p[1] + vx[2] * p[2] - g[1];
+      so = da * c[1] - db * c[0];
+      if ((so > fw) || (so < -fw))
+        continue;
+
+      // distance past inner face of nearest jaw
+      sc = (float) fabs(da * c[0] + db * c[1]);
+      free = sc - hw;
+      if (free < best)
+        best = free;
+    }
+  return((best > 0.0f) ? best : 0.0f);
+}
@@ -0,0 +1,265 @@
+// jhcTofGrid.cpp : overhead height map and obstacle distance grid
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <string.h>
+
+#include <jhcTofGrid.h>
+
+
+//= Squared distance meaning no obstacle seen.
+
+#define DT_INF 1e20f
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofGrid::jhcTofGrid ()
+{
+  int i;
+
+  // grid geometry
+  cell = 20.0f;                        // cell size (mm)
+  hobs = 30.0f;                        // min obstacle height (mm)
+  hmax = 1000.0f;                      // max robot height (mm)
+
+  // distance transform
+  dt = 1;                              // compute distances
+  dmax = 500.0f;                       // max reported distance (mm)
+
+  // no data yet
+  for (i = 0; i < 16384; i++)
+  {
+    hmap[i] = -32768;
+    dist[i] = dmax;
+  }
+  memset(occ, 0, sizeof(occ));
+  memset(occ0, 0, sizeof(occ0));
+  nobs = 0;
+  valid = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Make height map and obstacle grid from world frame points.
+// if "dt" > 0 then also updates distance to nearest obstacle for each cell
+// returns number of obstacle cells
+
+int jhcTofGrid::Build (const jhcTofCloud& cloud)
+{
+  int box[4];
+
+  height_map(cloud);
+  if (dt > 0)
+  {
+    if (valid <= 0)
+    {
+      // first time (or after Reset) do whole grid
+      box[0] = 0;
+      box[1] = 127;
+      box[2] = 0;
+      box[3] = 127;
+      update_dt(box);
+      valid = 1;
+    }
+    else if (changes(box) > 0)
+      update_dt(box);
+    memcpy(occ0, occ, sizeof(occ0));
+  }
+  return nobs;
+}
+
+
+//= Find tallest point in each cell and mark cells with obstacles.
+// cells with no points have height -32768
+
+void jhcTofGrid::height_map (const jhcTofCloud& cloud)
+{
+  const float *w = cloud.World(), *p = cloud.Cam();
+  float sc = 1.0f / cell;
+  int i, c, r, j, h;
+
+  // clear old maps
+  for (j = 0; j < 16384; j++)
+    hmap[j] = -32768;
+  memset(occ, 0, sizeof(occ));
+  nobs = 0;
+
+  // project each valid point into grid
+  for (i = 0; i < 10000; i++, w += 3, p += 3)
+  {
+    if (p[2] <= 0.0f)
+      continue;
+    c = (int) floorf((w[0] - cloud.cx) * sc + 64.0f);
+    r = (int) floorf(128.0f - (w[1] - cloud.cy) * sc);
+    if ((c < 0) || (c > 127) || (r < 0) || (r > 127))
+      continue;
+    j = (r << 7) + c;
+    h = (int)((w[2] >= 0.0f) ? w[2] + 0.5f : w[2] - 0.5f);
+    h = ((h < -32767) ? -32767 : ((h > 32767) ? 32767 : h));
+    if (h > hmap[j])
+      hmap[j] = (short) h;
+    if ((w[2] >= hobs) && (w[2] < hmax) && (occ[j] == 0))
+    {
+      occ[j] = 1;
+      nobs++;
+    }
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                          Distance Transform                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Find bounding box of cells whose obstacle status changed since last time.
+// box holds min x, max x, min y, max y
+// returns number of changed cells
+
+int jhcTofGrid::changes (int *box) const
+{
+  int x, y, i = 0, n = 0;
+
+  box[0] = 128;
+  box[1] = -1;
+  box[2] = 128;
+  box[3] = -1;
+  for (y = 0; y < 128; y++)
+    for (x = 0; x < 128; x++, i++)
+      if (occ[i] != occ0[i])
+      {
+        box[0] = ((x < box[0]) ? x : box[0]);
+        box[1] = ((x > box[1]) ? x : box[1]);
+        box[2] = ((y < box[2]) ? y : box[2]);
+        box[3] = ((y > box[3]) ? y : box[3]);
+        n++;
+      }
+  return n;
+}
+
+
+//= Recompute capped distances for all cells that changes in "box" can affect.
+// capped distances only depend on obstacles within cap so work is local:
+// cells within cap of box are redone using obstacles within twice the cap
+// separable: exact 1D transform down columns then along rows
+
+void jhcTofGrid::update_dt (const int *box)
+{
+  int win[4], src[4];
+  float sq, lim = dmax / cell;
+  int x, y, j, n, rad = (int) ceilf(lim);
+
+  // get output window and source area
+  for (j = 0; j < 4; j += 2)
+  {
+    win[j] = ((box[j] > rad) ? box[j] - rad : 0);
+    win[j + 1] = ((box[j + 1] < 127 - rad) ? box[j + 1] + rad : 127);
+    src[j] = ((win[j] > rad) ? win[j] - rad : 0);
+    src[j + 1] = ((win[j + 1] < 127 - rad) ? win[j + 1] + rad : 127);
+  }
+
+  // vertical distances for all source columns
+  n = src[3] - src[2] + 1;
+  for (x = src[0]; x <= src[1]; x++)
+  {
+    for (j = 0; j < n; j++)
+      f[j] = ((occ[((src[2] + j) << 7) + x] > 0) ? 0.0f : DT_INF);
+    edt_1d(n);
+    for (j = 0; j < n; j++)
+      col[((src[2] + j) << 7) + x] = d[j];
+  }
+
+  // combine horizontally for output rows then cap
+  n = src[1] - src[0] + 1;
+  lim *= lim;
+  for (y = win[2]; y <= win[3]; y++)
+  {
+    memcpy(f, col + (y << 7) + src[0], n * sizeof(float));
+    edt_1d(n);
+    for (x = win[0]; x <= win[1]; x++)
+    {
+      sq = d[x - src[0]];
+      dist[(y << 7) + x] = ((sq < lim) ? cell * sqrtf(sq) : dmax);
+    }
+  }
+}
+
+
+//= Exact 1D squared distance transform of "n" values in f[] into d[].
+// builds lower envelope of parabolas rooted at finite samples only
+// all outputs are DT_INF if there are no finite samples
+
+void jhcTofGrid::edt_1d (int n)
+{
+  float s, dq;
+  int q, k = -1;
+
+  // lower envelope
+  for (q = 0; q < n; q++)
+  {
+    if (f[q] >= DT_INF)
+      continue;
+    if (k < 0)
+    {
+      k = 0;
+      v[0] = q;
+      z[0] = -DT_INF;
+      z[1] = DT_INF;
+      continue;
+    }
+    s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * (q - v[k]));
+    while (s <= z[k])
+    {
+      k--;
+      s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * (q - v[k]));
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = DT_INF;
+  }
+
+  // nothing to measure from
+  if (k < 0)
+  {
+    for (q = 0; q < n; q++)
+      d[q] = DT_INF;
+    return;
+  }
+
+  // read off distances
+  k = 0;
+  for (q = 0; q < n; q++)
+  {
+    while (z[k + 1] < q)
+      k++;
+    dq = (float)(q - v[k]);
+    d[q] = dq * dq + f[v[k]];
+  }
+}
@@ -0,0 +1,331 @@
+// jhcTofHash.cpp : spatial hash of cloud points for neighborhood queries
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <string.h>
+
+#include <jhcTofHash.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofHash::jhcTofHash ()
+{
+  sz = 20.0f;                          // cell size (mm)
+  memset(pts, 0, sizeof(pts));
+  memset(cell, 0, sizeof(cell));
+  clear();
+  frame = 0;
+  valid = 0;
+}
+
+
+//= Empty all buckets.
+
+void jhcTofHash::clear ()
+{
+  int b;
+
+  for (b = 0; b < 8192; b++)
+    head[b] = -1;
+  memset(in, 0, sizeof(in));
+  npts = 0;
+  moved = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Bring index up to date with camera (world = 0) or world points of cloud.
+// only relinks pixels that changed validity or moved to a different cell
+// returns number of points indexed
+
+int jhcTofHash::Build (const jhcTofCloud& cloud, int world)
+{
+  const float *cam = cloud.Cam();
+  const float *src = ((world > 0) ? cloud.World() : cloud.Cam());
+  const float *s = src;
+  float *p = pts;
+  int *c = cell;
+  int i, ix, iy, iz;
+
+  // switching frames invalidates everything
+  if ((valid <= 0) || (world != frame))
+    clear();
+  frame = world;
+  valid = 1;
+  moved = 0;
+
+  // look for changes at each pixel
+  for (i = 0; i < 10000; i++, s += 3, p += 3, c += 3)
+  {
+    if (cam[3 * i + 2] <= 0.0f)
+    {
+      // point disappeared
+      if (in[i] > 0)
+      {
+        unlink(i);
+        in[i] = 0;
+        npts--;
+        moved++;
+      }
+      continue;
+    }
+    if ((in[i] > 0) && (s[0] == p[0]) && (s[1] == p[1]) && (s[2] == p[2]))
+      continue;
+
+    // point may have shifted within same cell
+    ix = (int) floorf(s[0] / sz);
+    iy = (int) floorf(s[1] / sz);
+    iz = (int) floorf(s[2] / sz);
+    p[0] = s[0];
+    p[1] = s[1];
+    p[2] = s[2];
+    if ((in[i] > 0) && (ix == c[0]) && (iy == c[1]) && (iz == c[2]))
+      continue;
+
+    // move to new bucket
+    if (in[i] > 0)
+      unlink(i);
+    else
+      npts++;
+    c[0] = ix;
+    c[1] = iy;
+    c[2] = iz;
+    link(i);
+    in[i] = 1;
+    moved++;
+  }
+  return npts;
+}
+
+
+//= Add pixel "i" to front of list for its cell.
+
+void jhcTofHash::link (int i)
+{
+  int b = bucket(cell[3 * i], cell[3 * i + 1], cell[3 * i + 2]);
+
+  prv[i] = -1;
+  nxt[i] = head[b];
+  if (head[b] >= 0)
+    prv[head[b]] = i;
+  head[b] = i;
+}
+
+
+//= Remove pixel "i" from list for its current cell.
+
+void jhcTofHash::unlink (int i)
+{
+  if (prv[i] >= 0)
+    nxt[prv[i]] = nxt[i];
+  else
+    head[bucket(cell[3 * i], cell[3 * i + 1], cell[3 * i + 2])] = nxt[i];
+  if (nxt[i] >= 0)
+    prv[nxt[i]] = prv[i];
+}
+
+
+//= Hash of integer cell coordinates into a bucket number.
+
+int jhcTofHash::bucket (int ix, int iy, int iz) const
+{
+  unsigned int h;
+
+  h = ((unsigned int) ix * 73856093U) ^ ((unsigned int) iy * 19349663U) ^ ((unsigned int) iz * 83492791U);
+  return (int)(h & 8191);
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                               Queries                                 //
+///////////////////////////////////////////////////////////////////////////
+
+//= Find pixels whose points are within "r" of "x", "y", "z" (same frame as Build).
+// saves at most "most" pixel indices in "ids" (in no particular order)
+// returns number of indices saved
+
+int jhcTofHash::Radius (int *ids, int most, float x, float y, float z, float r) const
+{
+  const float *p;
+  const int *c;
+  float dx, dy, dz, r2 = r * r;
+  int ix0, ix1, iy0, iy1, iz0, iz1, ix, iy, iz, i, n = 0;
+
+  // cells overlapping bounding cube of sphere
+  if ((valid <= 0) || (most <= 0) || (r < 0.0f))
+    return 0;
+  ix0 = (int) floorf((x - r) / sz);
+  ix1 = (int) floorf((x + r) / sz);
+  iy0 = (int) floorf((y - r) / sz);
+  iy1 = (int) floorf((y + r) / sz);
+  iz0 = (int) floorf((z - r) / sz);
+  iz1 = (int) floorf((z + r) / sz);
+
+  // huge spheres are faster to check point by point
+  if ((double)(ix1 - ix0 + 1) * (iy1 - iy0 + 1) * (iz1 - iz0 + 1) > npts)
+  {
+    for (i = 0, p = pts; i < 10000; i++, p += 3)
+      if (in[i] > 0)
+      {
+        dx = p[0] - x;
+        dy = p[1] - y;
+        dz = p[2] - z;
+        if (dx * dx + dy * dy + dz * dz <= r2)
+        {
+          ids[n++] = i;
+          if (n >= most)
+            break;
+        }
+      }
+    return n;
+  }
+
+  // walk bucket list for each cell ignoring points from other cells
+  for (iz = iz0; iz <= iz1; iz++)
+    for (iy = iy0; iy <= iy1; iy++)
+      for (ix = ix0; ix <= ix1; ix++)
+        for (i = head[bucket(ix, iy, iz)]; i >= 0; i = nxt[i])
+        {
+          c = cell + 3 * i;
+          if ((c[0] != ix) || (c[1] != iy) || (c[2] != iz))
+            continue;
+          p = pts + 3 * i;
+          dx = p[0] - x;
+          dy = p[1] - y;
+          dz = p[2] - z;
+          if (dx * dx + dy * dy + dz * dz <= r2)
+          {
+            ids[n++] = i;
+            if (n >= most)
+              return n;
+          }
+        }
+  return n;
+}
+
+
+//= Find up to "k" (max 100) points nearest to "x", "y", "z" but within "rmax".
+// saves pixel indices in "ids" and distances in "dist" (if not NULL), closest first
+// searches shells of cells outward from query and stops once no closer point is possible
+// returns number of neighbors found
+
+int jhcTofHash::Nearest (int *ids, float *dist, int k, float x, float y, float z, float rmax) const
+{
+  float d2[100];
+  const float *p;
+  const int *c;
+  float dx, dy, dz, v, lim = rmax * rmax;
+  int x0, y0, z0, ix, iy, iz, ox, oy, oz, dmax, r, i, n = 0;
+
+  if ((valid <= 0) || (k <= 0) || (rmax < 0.0f))
+    return 0;
+  k = ((k < 100) ? k : 100);
+  dmax = (int) ceilf(rmax / sz);
+
+  // very large search radius is faster point by point
+  if ((double)(2 * dmax + 1) * (2 * dmax + 1) * (2 * dmax + 1) > npts)
+  {
+    for (i = 0, p = pts; i < 10000; i++, p += 3)
+      if (in[i] > 0)
+      {
+        dx = p[0] - x;
+        dy = p[1] - y;
+        dz = p[2] - z;
+        if ((v = dx * dx + dy * dy + dz * dz) <= lim)
+          n = keep(ids, d2, n, k, i, v);
+      }
+  }
+  else
+  {
+    // examine cells at Chebyshev distance r from query cell
+    x0 = (int) floorf(x / sz);
+    y0 = (int) floorf(y / sz);
+    z0 = (int) floorf(z / sz);
+    for (r = 0; r <= dmax; r++)
+    {
+      for (oz = -r; oz <= r; oz++)
+        for (oy = -r; oy <= r; oy++)
+          for (ox = -r; ox <= r; ox++)
+          {
+            // only visit shell (skip interior already done)
+            if ((oz != -r) && (oz != r) && (oy != -r) && (oy != r) && (ox != -r))
+              ox = r;
+            ix = x0 + ox;
+            iy = y0 + oy;
+            iz = z0 + oz;
+            for (i = head[bucket(ix, iy, iz)]; i >= 0; i = nxt[i])
+            {
+              c = cell + 3 * i;
+              if ((c[0] != ix) || (c[1] != iy) || (c[2] != iz))
+                continue;
+              p = pts + 3 * i;
+              dx = p[0] - x;
+              dy = p[1] - y;
+              dz = p[2] - z;
+              if ((v = dx * dx + dy * dy + dz * dz) <= lim)
+                n = keep(ids, d2, n, k, i, v);
+            }
+          }
+
+      // anything in next shell is at least r cells away
+      v = r * sz;
+      if ((n >= k) && (d2[k - 1] <= v * v))
+        break;
+    }
+  }
+
+  // convert squared distances
+  if (dist != NULL)
+    for (i = 0; i < n; i++)
+      dist[i] = sqrtf(d2[i]);
+  return n;
+}
+
+
+//= Insert pixel "i" with squared distance "v" into sorted list of at most "k".
+// returns new number of entries in list
+
+int jhcTofHash::keep (int *ids, float *d2, int n, int k, int i, float v) const
+{
+  int j;
+
+  if ((n >= k) && (v >= d2[k - 1]))
+    return n;
+  j = ((n < k) ? n : k - 1);
+  while ((j > 0) && (d2[j - 1] > v))
+  {
+    ids[j] = ids[j - 1];
+    d2[j] = d2[j - 1];
+    j--;
+  }
+  ids[j] = i;
+  d2[j] = v;
+  return((n < k) ? n + 1 : k);
+}
@@ -0,0 +1,733 @@
+// jhcTofIcp.cpp : known object pose tracking by template ICP
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+
+#include <jhcTofIcp.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofIcp::jhcTofIcp ()
+{
+  int i;
+
+  // iteration control
+  iter = 20;                           // max ICP passes per frame
+  drot = 0.001f;                       // rotation change to stop (rad)
+  dpos = 0.1f;                         // translation change to stop (mm)
+
+  // matching
+  dmax = 20.0f;                        // max correspondence distance (mm)
+  ang = 45.0f;                         // max normal difference (degs)
+  nmin = 30;                           // min matches to keep tracking
+  rob = 3.0f;                          // robust residual scale (mm)
+
+  // scene normals
+  nstep = 1;                           // neighbor offset (pixels)
+  jump = 0.05f;                        // max depth change fraction
+
+  // threading
+  par = 1;                             // solve slots in parallel
+
+  // no templates yet
+  memset(snv, 0, sizeof(snv));
+  for (i = 0; i < 8; i++)
+  {
+    job[i].me = this;
+    job[i].slot = i;
+    Drop(i);
+  }
+  src = NULL;
+  msk = NULL;
+  sx = 1.0f;
+  sy = 1.0f;
+}
+
+
+//= Load template "i" with "n" points (x, y, z triples) and optional unit normals.
+// takes evenly spaced subset if more than MaxPts points given
+// pose must be set with SetPose before tracking starts
+// returns number of points kept, 0 if bad slot
+
+int jhcTofIcp::SetModel (int i, const float *pts, const float *nv, int n)
+{
+  const float *p, *v;
+  float len;
+  int k, j, cnt;
+
+  if ((i < 0) || (i >= 8) || (pts == NULL) || (n <= 0))
+    return 0;
+  cnt = ((n < 2000) ? n : 2000);
+  for (k = 0; k < cnt; k++)
+  {
+    j = (int)(((long long) k * n) / cnt);
+    p = pts + 3 * j;
+    mpt[i][3 * k]     = p[0];
+    mpt[i][3 * k + 1] = p[1];
+    mpt[i][3 * k + 2] = p[2];
+    if (nv == NULL)
+      continue;
+    v = nv + 3 * j;
+    len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    len = ((len > 0.0f) ? 1.0f / len : 0.0f);
+    mnv[i][3 * k]     = len * v[0];
+    mnv[i][3 * k + 1] = len * v[1];
+    mnv[i][3 * k + 2] = len * v[2];
+  }
+  nm[i] = cnt;
+  has_nv[i] = ((nv != NULL) ? 1 : 0);
+
+  // rotations are taken about template centroid
+  mc[i][0] = 0.0f;
+  mc[i][1] = 0.0f;
+  mc[i][2] = 0.0f;
+  for (k = 0; k < cnt; k++)
+    for (j = 0; j < 3; j++)
+      mc[i][j] += mpt[i][3 * k + j];
+  for (j = 0; j < 3; j++)
+    mc[i][j] /= cnt;
+  mrad[i] = 0.0f;
+  for (k = 0; k < cnt; k++)
+  {
+    p = mpt[i] + 3 * k;
+    len = (p[0] - mc[i][0]) * (p[0] - mc[i][0]) + (p[1] - mc[i][1]) * (p[1] - mc[i][1]) +
+          (p[2] - mc[i][2]) * (p[2] - mc[i][2]);
+    mrad[i] = ((len > mrad[i]) ? len : mrad[i]);
+  }
+  mrad[i] = sqrtf(mrad[i]);
+  stat[i] = 0;
+  return cnt;
+}
+
+
+//= Load template "i" from triangle mesh with "nv" vertices and "nt" triangles.
+// vertex normals are area weighted sums of face normals, each flipped
+// to point away from mesh centroid (so winding order does not matter)
+// returns number of points kept, 0 if bad slot
+
+int jhcTofIcp::SetMesh (int i, const float *verts, int nv, const int *tris, int nt)
+{
+  float *norm;
+  const float *a, *b, *c;
+  const int *t = tris;
+  float e1[3], e2[3], f[3], mid[3] = {0.0f, 0.0f, 0.0f};
+  float dot;
+  int j, k, cnt;
+
+  if ((verts == NULL) || (nv <= 0))
+    return 0;
+  norm = new float [3 * nv];
+  memset(norm, 0, 3 * nv * sizeof(float));
+
+  // accumulate face normals (length = twice triangle area)
+  for (j = 0; j < nt; j++, t += 3)
+  {
+    if ((t[0] < 0) || (t[0] >= nv) || (t[1] < 0) || (t[1] >= nv) || (t[2] < 0) || (t[2] >= nv))
+      continue;
+    a = verts + 3 * t[0];
+    b = verts + 3 * t[1];
+    c = verts + 3 * t[2];
+    for (k = 0; k < 3; k++)
+    {
+      e1[k] = b[k] - a[k];
+      e2[k] = c[k] - a[k];
+    }
+    f[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    f[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    f[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    for (k = 0; k < 3; k++)
+    {
+      norm[3 * t[0] + k] += f[k];
+      norm[3 * t[1] + k] += f[k];
+      norm[3 * t[2] + k] += f[k];
+    }
+  }
+
+  // orient outward from centroid
+  for (j = 0; j < nv; j++)
+    for (k = 0; k < 3; k++)
+      mid[k] += verts[3 * j + k];
+  for (k = 0; k < 3; k++)
+    mid[k] /= nv;
+  for (j = 0; j < nv; j++)
+  {
+    dot = 0.0f;
+    for (k = 0; k < 3; k++)
+      dot += norm[3 * j + k] * (verts[3 * j + k] - mid[k]);
+    if (dot < 0.0f)
+      for (k = 0; k < 3; k++)
+        norm[3 * j + k] = -norm[3 * j + k];
+  }
+  cnt = SetModel(i, verts, norm, nv);
+  delete [] norm;
+  return cnt;
+}
+
+
+//= Load template "i" from binary PLY mesh file like jhcTofMesh::SavePly makes.
+// returns number of points kept, 0 if file problem or bad slot
+
+int jhcTofIcp::LoadPly (int i, const char *fname)
+{
+  char line[200];
+  FILE *in;
+  float *verts = NULL;
+  int *tris = NULL;
+  unsigned char n;
+  int j, nv = 0, nt = 0, ok = 1, cnt = 0;
+
+  // parse header for element counts
+  if ((in = fopen(fname, "rb")) == NULL)
+    return 0;
+  while (fgets(line, 200, in) != NULL)
+  {
+    if (strncmp(line, "end_header", 10) == 0)
+      break;
+    if (sscanf(line, "element vertex %d", &j) == 1)
+      nv = j;
+    else if (sscanf(line, "element face %d", &j) == 1)
+      nt = j;
+  }
+
+  // read vertices then triangles (assumes little endian host)
+  if (nv > 0)
+  {
+    verts = new float [3 * nv];
+    tris = new int [3 * nt + 3];
+    if (fread(verts, 3 * sizeof(float), nv, in) != (size_t) nv)
+      ok = 0;
+    for (j = 0; (j < nt) && (ok > 0); j++)
+      if ((fread(&n, 1, 1, in) != 1) || (n != 3) ||
+          (fread(tris + 3 * j, sizeof(int), 3, in) != 3))
+        ok = 0;
+    if (ok > 0)
+      cnt = ((nt > 0) ? SetMesh(i, verts, nv, tris, nt) : SetModel(i, verts, NULL, nv));
+    delete [] tris;
+    delete [] verts;
+  }
+  fclose(in);
+  return cnt;
+}
+
+
+//= Set starting pose of template "i" as rotation "r" (row major) and shift "t".
+// template point m appears in camera frame at r * m + t (mm)
+// returns 1 if okay, 0 if no template
+
+int jhcTofIcp::SetPose (int i, const float *r, const float *t)
+{
+  int k;
+
+  if ((i < 0) || (i >= 8) || (nm[i] <= 0))
+    return 0;
+  for (k = 0; k < 9; k++)
+    rot[i][k] = r[k];
+  for (k = 0; k < 3; k++)
+    pos[i][k] = t[k];
+  stat[i] = 2;
+  return 1;
+}
+
+
+//= Forget template and pose for slot "i".
+
+void jhcTofIcp::Drop (int i)
+{
+  int k;
+
+  if ((i < 0) || (i >= 8))
+    return;
+  nm[i] = 0;
+  has_nv[i] = 0;
+  for (k = 0; k < 9; k++)
+    rot[i][k] = (((k % 4) == 0) ? 1.0 : 0.0);
+  for (k = 0; k < 3; k++)
+    pos[i][k] = 0.0;
+  fit[i] = 0.0f;
+  err[i] = 0.0f;
+  stat[i] = 0;
+  used[i] = 0;
+  its[i] = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Refine pose of every placed template using camera points in "cloud".
+// "mask" is an optional image where only non-zero pixels can be matched
+// returns number of templates currently tracking
+
+int jhcTofIcp::Update (const jhcTofCloud& cloud, const unsigned short *mask)
+{
+  pthread_t th[8];
+  int box[4] = {100, -1, 100, -1};
+  int run[8];
+  int i, act = 0, cnt = 0;
+
+  // shared data for all slots
+  src = &cloud;
+  msk = mask;
+  sx = cloud.asp / cloud.flen;
+  sy = 1.0f / cloud.flen;
+  for (i = 0; i < 8; i++)
+    if (stat[i] > 0)
+    {
+      footprint(box, i);
+      act++;
+    }
+  scene_normals(cloud.Cam(), box);
+
+  // refine each pose (separate threads if several, inline if no thread)
+  if ((par > 0) && (act > 1))
+  {
+    for (i = 0; i < 8; i++)
+    {
+      run[i] = 0;
+      if (stat[i] <= 0)
+        continue;
+      if (pthread_create(th + i, NULL, solver, (void *)(job + i)) == 0)
+        run[i] = 1;
+      else
+        track(i);
+    }
+    for (i = 0; i < 8; i++)
+      if (run[i] > 0)
+        pthread_join(th[i], NULL);
+  }
+  else
+    for (i = 0; i < 8; i++)
+      if (stat[i] > 0)
+        track(i);
+
+  // count successes
+  for (i = 0; i < 8; i++)
+    if (stat[i] >= 2)
+      cnt++;
+  return cnt;
+}
+
+
+//= Get current pose of template "i" as rotation "r" (row major) and shift "t".
+// returns status (0 = empty, 1 = lost, 2 = tracking)
+
+int jhcTofIcp::Pose (int i, float *r, float *t) const
+{
+  int k;
+
+  if ((i < 0) || (i >= 8))
+    return 0;
+  for (k = 0; k < 9; k++)
+    r[k] = (float) rot[i][k];
+  for (k = 0; k < 3; k++)
+    t[k] = (float) pos[i][k];
+  return stat[i];
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                            Scene Normals                              //
+///////////////////////////////////////////////////////////////////////////
+
+//= Expand pixel "box" (x0, x1, y0, y1) to cover where template "i" might land.
+// uses bounding cube of template sphere enlarged by max match distance
+
+void jhcTofIcp::footprint (int *box, int i) const
+{
+  double c[3];
+  float r = mrad[i] + dmax, zn, zf, lo, hi;
+  int v;
+
+  // whole image if very close to camera
+  center(c, i);
+  if ((zn = (float) c[2] - r) <= 0.0f)
+  {
+    box[0] = 0;
+    box[1] = 99;
+    box[2] = 0;
+    box[3] = 99;
+    return;
+  }
+  zf = (float) c[2] + r;
+
+  // extreme ray slopes occur at corners of cube
+  lo = (float) c[0] - r;
+  hi = (float) c[0] + r;
+  lo = ((lo < 0.0f) ? lo / zn : lo / zf);
+  hi = ((hi > 0.0f) ? hi / zn : hi / zf);
+  if ((v = (int) floorf(lo / sx + 50.0f)) < box[0])
+    box[0] = v;
+  if ((v = (int) floorf(hi / sx + 50.0f)) > box[1])
+    box[1] = v;
+  lo = (float) c[1] - r;
+  hi = (float) c[1] + r;
+  lo = ((lo < 0.0f) ? lo / zn : lo / zf);
+  hi = ((hi > 0.0f) ? hi / zn : hi / zf);
+  if ((v = (int) floorf(lo / sy + 50.0f)) < box[2])
+    box[2] = v;
+  if ((v = (int) floorf(hi / sy + 50.0f)) > box[3])
+    box[3] = v;
+}
+
+
+//= Estimate unit normal facing camera at pixels in "box" from neighbor points.
+// uses central differences across rows and columns where possible but
+// falls back to one-sided differences at depth edges, no normal (all zero)
+// if some direction has no neighbor at a similar depth
+
+void jhcTofIcp::scene_normals (const float *pts, const int *box)
+{
+  const float *p;
+  float *n;
+  float a[3], b[3], c[3], len;
+  int x, y, s = nstep, row = 300 * nstep;
+  int x0 = ((box[0] > s) ? box[0] : s), x1 = ((box[1] < 99 - s) ? box[1] : 99 - s);
+  int y0 = ((box[2] > s) ? box[2] : s), y1 = ((box[3] < 99 - s) ? box[3] : 99 - s);
+
+  memset(snv, 0, sizeof(snv));
+  for (y = y0; y <= y1; y++)
+    for (x = x0; x <= x1; x++)
+    {
+      // get surface tangents along row and column
+      p = pts + 3 * (100 * y + x);
+      if ((p[2] <= 0.0f) ||
+          (tangent(a, p, p - 3 * s, p + 3 * s) <= 0) ||
+          (tangent(b, p, p - row, p + row) <= 0))
+        continue;
+
+      // cross product of tangents oriented toward camera
+      c[0] = a[1] * b[2] - a[2] * b[1];
+      c[1] = a[2] * b[0] - a[0] * b[2];
+      c[2] = a[0] * b[1] - a[1] * b[0];
+      if ((len = sqrtf(c[0] * c[0] + c[1] * c[1] + c[2] * c[2])) <= 0.0f)
+        continue;
+      if (c[0] * p[0] + c[1] * p[1] + c[2] * p[2] > 0.0f)
+        len = -len;
+      n = snv + (p - pts);
+      n[0] = c[0] / len;
+      n[1] = c[1] / len;
+      n[2] = c[2] / len;
+    }
+}
+
+
+//= Get tangent "t" at point "p" from neighbors "lo" and "hi" on either side.
+// neighbors count only if valid and depth differs by less than jump fraction
+// returns 1 if okay, 0 if neither neighbor usable
+
+int jhcTofIcp::tangent (float *t, const float *p, const float *lo, const float *hi) const
+{
+  float lim = jump * p[2];
+  int k, lok, hok;
+
+  lok = (((lo[2] > 0.0f) && (fabsf(lo[2] - p[2]) <= lim)) ? 1 : 0);
+  hok = (((hi[2] > 0.0f) && (fabsf(hi[2] - p[2]) <= lim)) ? 1 : 0);
+  if ((lok <= 0) && (hok <= 0))
+    return 0;
+  if (lok <= 0)
+    lo = p;
+  else if (hok <= 0)
+    hi = p;
+  for (k = 0; k < 3; k++)
+    t[k] = hi[k] - lo[k];
+  return 1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                             Registration                              //
+///////////////////////////////////////////////////////////////////////////
+
+//= Thread entry point for refining pose of one slot.
+
+void *jhcTofIcp::solver (void *arg)
+{
+  struct icp_job *j = (struct icp_job *) arg;
+
+  j->me->track(j->slot);
+  return NULL;
+}
+
+
+//= Iterate point-to-plane ICP for template "i" until converged or lost.
+
+void jhcTofIcp::track (int i)
+{
+  double x[6];
+  double rms = 0.0;
+  int n, vis = 0;
+
+  for (its[i] = 0; its[i] < iter; its[i]++)
+  {
+    // find matches and best small motion
+    n = step(x, rms, vis, i);
+    used[i] = n;
+    fit[i] = ((vis > 0) ? n / (float) vis : 0.0f);
+    err[i] = (float) rms;
+    if (n < nmin)
+    {
+      stat[i] = 1;
+      return;
+    }
+    stat[i] = 2;
+
+    // stop when motion is negligible
+    apply(i, x);
+    if ((sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]) < drot) &&
+        (sqrt(x[3] * x[3] + x[4] * x[4] + x[5] * x[5]) < dpos))
+      break;
+  }
+}
+
+
+//= Match projected template "i" points to scene and solve for motion "x".
+// motion is small rotation vector about template centroid then translation
+// also gets rms point-to-plane error and count of visible template points
+// returns number of matches used
+
+int jhcTofIcp::step (double *x, double& rms, int& vis, int i) const
+{
+  double a[36], b[6], jac[6];
+  const double *r = rot[i], *t = pos[i];
+  const float *m = mpt[i], *mn = mnv[i], *pts = src->Cam(), *s, *sn;
+  double q[3], nq[3] = {0.0, 0.0, 0.0}, d[3], cq[3], res, w, sse = 0.0;
+  double rs2 = 1.0 / (rob * rob);
+  float ca = cosf(ang * 0.0174533f), d2 = dmax * dmax;
+  int k, j, u, v, px, py, cnt = 0;
+
+  memset(a, 0, sizeof(a));
+  memset(b, 0, sizeof(b));
+  center(cq, i);
+  vis = 0;
+  for (k = 0; k < nm[i]; k++, m += 3, mn += 3)
+  {
+    // transform template point (and normal) into camera frame
+    q[0] = r[0] * m[0] + r[1] * m[1] + r[2] * m[2] + t[0];
+    q[1] = r[3] * m[0] + r[4] * m[1] + r[5] * m[2] + t[1];
+    q[2] = r[6] * m[0] + r[7] * m[1] + r[8] * m[2] + t[2];
+    if (q[2] <= 0.0)
+      continue;
+    if (has_nv[i] > 0)
+    {
+      nq[0] = r[0] * mn[0] + r[1] * mn[1] + r[2] * mn[2];
+      nq[1] = r[3] * mn[0] + r[4] * mn[1] + r[5] * mn[2];
+      nq[2] = r[6] * mn[0] + r[7] * mn[1] + r[8] * mn[2];
+      if (nq[0] * q[0] + nq[1] * q[1] + nq[2] * q[2] >= 0.0)
+        continue;
+    }
+
+    // project into image to find corresponding scene pixel
+    px = (int) floor(q[0] / (q[2] * sx) + 50.0);
+    py = (int) floor(q[1] / (q[2] * sy) + 50.0);
+    if ((px < 0) || (px > 99) || (py < 0) || (py > 99))
+      continue;
+    vis++;
+    j = 100 * py + px;
+    if ((msk != NULL) && (msk[j] == 0))
+      continue;
+    s = pts + 3 * j;
+    sn = snv + 3 * j;
+    if ((s[2] <= 0.0f) || ((sn[0] == 0.0f) && (sn[1] == 0.0f) && (sn[2] == 0.0f)))
+      continue;
+
+    // reject distant matches and ones with very different orientation
+    d[0] = q[0] - s[0];
+    d[1] = q[1] - s[1];
+    d[2] = q[2] - s[2];
+    if (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] > d2)
+      continue;
+    if ((has_nv[i] > 0) && (nq[0] * sn[0] + nq[1] * sn[1] + nq[2] * sn[2] < ca))
+      continue;
+
+    // residual along scene normal and its derivatives for (w, dt)
+    // with robust weight so flickering edge matches cannot cause oscillation
+    res = d[0] * sn[0] + d[1] * sn[1] + d[2] * sn[2];
+    jac[0] = (q[1] - cq[1]) * sn[2] - (q[2] - cq[2]) * sn[1];
+    jac[1] = (q[2] - cq[2]) * sn[0] - (q[0] - cq[0]) * sn[2];
+    jac[2] = (q[0] - cq[0]) * sn[1] - (q[1] - cq[1]) * sn[0];
+    jac[3] = sn[0];
+    jac[4] = sn[1];
+    jac[5] = sn[2];
+    w = 1.0 / (1.0 + res * res * rs2);
+    for (u = 0; u < 6; u++)
+    {
+      for (v = u; v < 6; v++)
+        a[6 * u + v] += w * jac[u] * jac[v];
+      b[u] -= w * jac[u] * res;
+    }
+    sse += res * res;
+    cnt++;
+  }
+
+  // solve normal equations (lower half mirrors upper)
+  rms = ((cnt > 0) ? sqrt(sse / cnt) : 0.0);
+  if (cnt < nmin)
+    return cnt;
+  for (u = 1; u < 6; u++)
+    for (v = 0; v < u; v++)
+      a[6 * u + v] = a[6 * v + u];
+  if (solve6(x, a, b) <= 0)
+    return 0;
+  return cnt;
+}
+
+
+//= Solve 6x6 system "a" x = "b" by Gaussian elimination with partial pivoting.
+// adds slight damping so directions the surface does not constrain stay put
+// destroys "a" and "b", returns 1 if okay, 0 if singular
+
+int jhcTofIcp::solve6 (double *x, double *a, double *b) const
+{
+  double tr = 0.0, f, tmp;
+  int i, j, k, best;
+
+  for (i = 0; i < 6; i++)
+    tr += a[7 * i];
+  for (i = 0; i < 6; i++)
+    a[7 * i] += 1e-6 * tr / 6.0;
+
+  // forward elimination
+  for (i = 0; i < 6; i++)
+  {
+    best = i;
+    for (j = i + 1; j < 6; j++)
+      if (fabs(a[6 * j + i]) > fabs(a[6 * best + i]))
+        best = j;
+    if (fabs(a[6 * best + i]) < 1e-12)
+      return 0;
+    if (best != i)
+    {
+      for (k = 0; k < 6; k++)
+      {
+        tmp = a[6 * i + k];
+        a[6 * i + k] = a[6 * best + k];
+        a[6 * best + k] = tmp;
+      }
+      tmp = b[i];
+      b[i] = b[best];
+      b[best] = tmp;
+    }
+    for (j = i + 1; j < 6; j++)
+    {
+      f = a[6 * j + i] / a[7 * i];
+      for (k = i; k < 6; k++)
+        a[6 * j + k] -= f * a[6 * i + k];
+      b[j] -= f * b[i];
+    }
+  }
+
+  // back substitution
+  for (i = 5; i >= 0; i--)
+  {
+    tmp = b[i];
+    for (k = i + 1; k < 6; k++)
+      tmp -= a[6 * i + k] * x[k];
+    x[i] = tmp / a[7 * i];
+  }
+  return 1;
+}
+
+
+//= Get current camera frame position "c" of template "i" centroid.
+
+void jhcTofIcp::center (double *c, int i) const
+{
+  const double *r = rot[i], *t = pos[i];
+  const float *m = mc[i];
+
+  c[0] = r[0] * m[0] + r[1] * m[1] + r[2] * m[2] + t[0];
+  c[1] = r[3] * m[0] + r[4] * m[1] + r[5] * m[2] + t[1];
+  c[2] = r[6] * m[0] + r[7] * m[1] + r[8] * m[2] + t[2];
+}
+
+
+//= Compose small motion "x" (rotation vector, translation) with pose of slot "i".
+// rows of rotation are re-orthonormalized to stop drift
+
+void jhcTofIcp::apply (int i, const double *x)
+{
+  double d[9], r2[9], t2[3], ax[3], c0[3];
+  double *r = rot[i], *t = pos[i];
+  double th, c, s, v, len, dot;
+  int j, k;
+
+  // Rodrigues formula for incremental rotation
+  th = sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+  if (th > 1e-12)
+    for (k = 0; k < 3; k++)
+      ax[k] = x[k] / th;
+  else
+  {
+    ax[0] = 1.0;
+    ax[1] = 0.0;
+    ax[2] = 0.0;
+  }
+  c = cos(th);
+  s = sin(th);
+  v = 1.0 - c;
+  d[0] = c + ax[0] * ax[0] * v;
+  d[1] = ax[0] * ax[1] * v - ax[2] * s;
+  d[2] = ax[0] * ax[2] * v + ax[1] * s;
+  d[3] = ax[1] * ax[0] * v + ax[2] * s;
+  d[4] = c + ax[1] * ax[1] * v;
+  d[5] = ax[1] * ax[2] * v - ax[0] * s;
+  d[6] = ax[2] * ax[0] * v - ax[1] * s;
+  d[7] = ax[2] * ax[1] * v + ax[0] * s;
+  d[8] = c + ax[2] * ax[2] * v;
+
+  // new pose is D * R and D * (t - c) + c + dt
+  center(c0, i);
+  for (j = 0; j < 3; j++)
+  {
+    for (k = 0; k < 3; k++)
+      r2[3 * j + k] = d[3 * j] * r[k] + d[3 * j + 1] * r[3 + k] + d[3 * j + 2] * r[6 + k];
+    t2[j] = d[3 * j] * (t[0] - c0[0]) + d[3 * j + 1] * (t[1] - c0[1]) + d[3 * j + 2] * (t[2] - c0[2]) 
+            + c0[j] + x[3 + j];
+  }
+
+  // Gram-Schmidt on rows
+  for (j = 0; j < 3; j++)
+  {
+    for (k = 0; k < j; k++)
+    {
+      dot = r2[3 * j] * r2[3 * k] + r2[3 * j + 1] * r2[3 * k + 1] + r2[3 * j + 2] * r2[3 * k + 2];
+      r2[3 * j]     -= dot * r2[3 * k];
+      r2[3 * j + 1] -= dot * r2[3 * k + 1];
+      r2[3 * j + 2] -= dot * r2[3 * k + 2];
+    }
+    len = sqrt(r2[3 * j] * r2[3 * j] + r2[3 * j + 1] * r2[3 * j + 1] + r2[3 * j + 2] * r2[3 * j + 2]);
+    for (k = 0; k < 3; k++)
+    {
+      r2[3 * j + k] /= len;            // later rows project onto unit row
+      r[3 * j + k] = r2[3 * j + k];
+    }
+    t[j] = t2[j];
+  }
+}
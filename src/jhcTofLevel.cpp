@@ -0,0 +1,204 @@
+// jhcTofLevel.cpp : tracks camera tilt, roll, and height from floor over time
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <string.h>
+
+#include <jhcTofLevel.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofLevel::jhcTofLevel ()
+{
+  // floor sampling
+  step = 4;                            // sample every Nth pixel
+  ptol = 15.0f;                        // max floor deviation (mm)
+  pwide = 60.0f;                       // initial search band (mm)
+
+  // tracking
+  decay = 0.95f;                       // old evidence kept per frame
+  nmin = 50;                           // min floor samples per frame
+  lost = 5;                            // bad frames before giving up
+
+  // bump detection
+  dang = 2.0f;                         // tilt or roll change (degs)
+  dhgt = 20.0f;                        // height change (mm)
+
+  // no estimate yet
+  memset(acc, 0, sizeof(acc));
+  pn[0] = 0.0f;
+  pn[1] = -1.0f;
+  pn[2] = 0.0f;
+  pd = 0.0f;
+  t0 = 0.0f;
+  r0 = 0.0f;
+  h0 = 0.0f;
+  seeded = 0;
+  miss = 0;
+  chg = 0;
+  jumps = 0;
+}
+
+
+//= Start tracking from floor plane "n" . p + "d" = 0 in camera frame.
+// normal is flipped if needed so camera is on positive side
+// returns 1 if okay, 0 if bad plane
+
+int jhcTofLevel::Seed (const float *n, float d)
+{
+  float s = ((d < 0.0f) ? -1.0f : 1.0f), len;
+
+  len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  if ((len <= 0.0f) || (d == 0.0f))
+    return 0;
+  pn[0] = s * n[0] / len;
+  pn[1] = s * n[1] / len;
+  pn[2] = s * n[2] / len;
+  pd = s * d / len;
+  memset(acc, 0, sizeof(acc));
+  pose();
+  seeded = 1;
+  miss = 0;
+  return 1;
+}
+
+
+//= Start tracking from floor implied by current cloud pose (needs cz > 0).
+// returns 1 if okay, 0 if bad pose
+
+int jhcTofLevel::Seed (const jhcTofCloud& cloud)
+{
+  const float *r = cloud.Rot();
+  float up[3] = {r[6], r[7], r[8]};
+
+  // world Z direction expressed in camera frame
+  if (cloud.cz <= 0.0f)
+    return 0;
+  return Seed(up, cloud.cz);
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Add floor evidence from latest cloud and refit plane.
+// if "fix" > 0 then also changes tilt, roll, and cz of cloud pose
+// (cloud points are not recomputed until next Convert)
+// returns 1 if tracking, 0 if lost or never seeded
+
+int jhcTofLevel::Update (jhcTofCloud& cloud, int fix)
+{
+  double m[10];
+  float fn[3];
+  float fd, dot;
+  int i;
+
+  // find floor in this frame alone (wide band then narrow band)
+  chg = 0;
+  if ((seeded <= 0) && (Seed(cloud) <= 0))
+    return 0;
+  if ((floor_pts(m, cloud.Cam(), pn, pd, pwide) < nmin) ||
+      (jhcTofCloud::FitPlane(fn, fd, m) < 0.0f) ||
+      (floor_pts(m, cloud.Cam(), fn, fd, ptol) < nmin) ||
+      (jhcTofCloud::FitPlane(fn, fd, m) < 0.0f))
+  {
+    if (++miss >= lost)
+    {
+      seeded = 0;
+      chg = 1;
+      jumps++;
+    }
+    return seeded;
+  }
+  miss = 0;
+
+  // restart if this frame alone is very different, else blend
+  dot = fn[0] * pn[0] + fn[1] * pn[1] + fn[2] * pn[2];
+  if ((acc[0] <= 0.0) ||
+      (dot < cosf(dang * 0.0174533f)) || (fabsf(fd - pd) > dhgt))
+  {
+    if (acc[0] > 0.0)
+    {
+      chg = 1;
+      jumps++;
+    }
+    memcpy(acc, m, sizeof(acc));
+  }
+  else
+    for (i = 0; i < 10; i++)
+      acc[i] = decay * acc[i] + m[i];
+
+  // refit plane to all remembered evidence
+  jhcTofCloud::FitPlane(pn, pd, acc);
+  pose();
+  if (fix > 0)
+  {
+    cloud.tilt = t0;
+    cloud.roll = r0;
+    cloud.cz = h0;
+  }
+  return 1;
+}
+
+
+//= Collect moments of sampled points within "tol" of plane "n" and "d".
+// returns number of points used
+
+int jhcTofLevel::floor_pts (double *m, const float *pts, const float *n, float d, float tol) const
+{
+  const float *p;
+  float h;
+  int i, j, off = step >> 1;
+
+  memset(m, 0, 10 * sizeof(double));
+  for (i = off; i < 100; i += step)
+    for (j = off; j < 100; j += step)
+    {
+      p = pts + 3 * (100 * i + j);
+      if (p[2] <= 0.0f)
+        continue;
+      h = n[0] * p[0] + n[1] * p[1] + n[2] * p[2] + d;
+      if ((h > tol) || (h < -tol))
+        continue;
+      jhcTofCloud::AddMoments(m, p);
+    }
+  return (int) m[0];
+}
+
+
+//= Convert floor plane into camera tilt, roll, and height.
+// floor normal in camera frame is (-cos(t) sin(r), -cos(t) cos(r), sin(t))
+
+void jhcTofLevel::pose ()
+{
+  float nz = ((pn[2] > 1.0f) ? 1.0f : ((pn[2] < -1.0f) ? -1.0f : pn[2]));
+
+  t0 = (float)(asin(nz) * 57.29578);
+  r0 = (float)(atan2(-pn[0], -pn[1]) * 57.29578);
+  h0 = pd;
+}
@@ -0,0 +1,190 @@
+// jhcTofMesh.cpp : triangulates organized TOF point cloud into surface mesh
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+
+#include <jhcTofMesh.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofMesh::jhcTofMesh ()
+{
+  // depth discontinuity test
+  dabs = 20.0f;                        // always allowed step (mm)
+  frac = 0.05f;                        // extra step per unit depth
+
+  // no mesh yet
+  nv = 0;
+  nt = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Triangulate camera (world = 0) or world frame points from cloud.
+// a triangle needs 3 valid corners with no depth jumps between them
+// cells with 4 good corners are split along shorter 3D diagonal
+// returns number of triangles made
+
+int jhcTofMesh::Build (const jhcTofCloud& cloud, int world)
+{
+  const float *cam = cloud.Cam(), *pts = ((world > 0) ? cloud.World() : cam);
+  const float *pa, *pb, *pc, *pd;
+  float ad, bc, dx, dy, dz;
+  int x, y, a, b, c, d, ok;
+
+  // no vertices used yet
+  for (a = 0; a < 10000; a++)
+    vidx[a] = -1;
+  nv = 0;
+  nt = 0;
+
+  // examine each 2x2 cell:  a b
+  //                         c d
+  for (y = 0; y < 99; y++)
+    for (x = 0; x < 99; x++)
+    {
+      // find which corners are valid (depth in camera z)
+      a = 100 * y + x;
+      b = a + 1;
+      c = a + 100;
+      d = c + 1;
+      pa = cam + 3 * a;
+      pb = cam + 3 * b;
+      pc = cam + 3 * c;
+      pd = cam + 3 * d;
+      ok = ((pa[2] > 0.0f) ? 1 : 0) + ((pb[2] > 0.0f) ? 2 : 0) +
+           ((pc[2] > 0.0f) ? 4 : 0) + ((pd[2] > 0.0f) ? 8 : 0);
+
+      // all four present so pick shorter diagonal
+      if (ok == 15)
+      {
+        dx = pd[0] - pa[0];
+        dy = pd[1] - pa[1];
+        dz = pd[2] - pa[2];
+        ad = dx * dx + dy * dy + dz * dz;
+        dx = pc[0] - pb[0];
+        dy = pc[1] - pb[1];
+        dz = pc[2] - pb[2];
+        bc = dx * dx + dy * dy + dz * dz;
+        if (ad <= bc)
+        {
+          add_tri(a, c, d, cam, pts);
+          add_tri(a, d, b, cam, pts);
+        }
+        else
+        {
+          add_tri(a, c, b, cam, pts);
+          add_tri(b, c, d, cam, pts);
+        }
+      }
+
+      // only three present so at most one triangle
+      else if (ok == 14)
+        add_tri(b, c, d, cam, pts);
+      else if (ok == 13)
+        add_tri(a, c, d, cam, pts);
+      else if (ok == 11)
+        add_tri(a, d, b, cam, pts);
+      else if (ok == 7)
+        add_tri(a, c, b, cam, pts);
+    }
+  return nt;
+}
+
+
+//= Check that two points at camera depths "za" and "zb" are on same surface.
+
+int jhcTofMesh::joined (float za, float zb) const
+{
+  float dz = za - zb, lim = dabs + frac * ((za < zb) ? za : zb);
+
+  return(((dz <= lim) && (dz >= -lim)) ? 1 : 0);
+}
+
+
+//= Add triangle with pixel corners "a", "b", and "c" if no depth jumps.
+// depth test uses camera z even if vertices come from world frame
+
+void jhcTofMesh::add_tri (int a, int b, int c, const float *cam, const float *pts)
+{
+  float za = cam[3 * a + 2], zb = cam[3 * b + 2], zc = cam[3 * c + 2];
+
+  if (!joined(za, zb) || !joined(zb, zc) || !joined(zc, za))
+    return;
+  tri[3 * nt]     = get_vert(a, pts);
+  tri[3 * nt + 1] = get_vert(b, pts);
+  tri[3 * nt + 2] = get_vert(c, pts);
+  nt++;
+}
+
+
+//= Get vertex index for pixel, adding its point to vertex list if needed.
+
+int jhcTofMesh::get_vert (int i, const float *pts)
+{
+  if (vidx[i] < 0)
+  {
+    memcpy(vert + 3 * nv, pts + 3 * i, 3 * sizeof(float));
+    vidx[i] = nv++;
+  }
+  return vidx[i];
+}
+
+
+//= Write current mesh to a binary PLY file (little endian).
+// returns 1 if okay, 0 for file problem
+
+int jhcTofMesh::SavePly (const char *fname) const
+{
+  FILE *out;
+  unsigned char n = 3;
+  int i, ok = 1;
+
+  // write header describing vertex and face lists
+  if ((out = fopen(fname, "wb")) == NULL)
+    return 0;
+  fprintf(out, "ply\nformat binary_little_endian 1.0\n");
+  fprintf(out, "comment A010 TOF mesh (mm)\n");
+  fprintf(out, "element vertex %d\n", nv);
+  fprintf(out, "property float x\nproperty float y\nproperty float z\n");
+  fprintf(out, "element face %d\n", nt);
+  fprintf(out, "property list uchar int vertex_indices\nend_header\n");
+
+  // write raw data (assumes little endian host)
+  if (fwrite(vert, 3 * sizeof(float), nv, out) != (size_t) nv)
+    ok = 0;
+  for (i = 0; (i < nt) && (ok > 0); i++)
+    if ((fwrite(&n, 1, 1, out) != 1) || (fwrite(tri + 3 * i, sizeof(int), 3, out) != 3))
+      ok = 0;
+  if (fclose(out) != 0)
+    ok = 0;
+  return ok;
+}
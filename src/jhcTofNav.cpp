@@ -0,0 +1,159 @@
+// jhcTofNav.cpp : finds how far floor is clear in each direction for navigation
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+
+#include <jhcTofNav.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofNav::jhcTofNav ()
+{
+  int x;
+
+  // height limits
+  hobs = 30.0f;                        // min obstacle height (mm)
+  hmax = 1000.0f;                      // max robot height (mm)
+  drop = 40.0f;                        // min depth of hole (mm)
+
+  // missing data
+  gap = 5;                             // max invalid run (pixels)
+
+  // no data yet
+  for (x = 0; x < 100; x++)
+  {
+    fdist[x] = 0.0f;
+    odist[x] = 0.0f;
+    bear[x] = 0.0f;
+    why[x] = 0;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Find free floor distance for every image column in one upward pass.
+// uses world frame points from jhcTofCloud
+// returns number of columns where some floor was seen
+
+int jhcTofNav::Analyze (const jhcTofCloud& cloud)
+{
+  int x, cnt = 0;
+
+  for (x = 0; x < 100; x++)
+  {
+    scan_col(cloud, x);
+    if (fdist[x] > 0.0f)
+      cnt++;
+  }
+  return cnt;
+}
+
+
+//= Scan column "x" from bottom until floor stops being visible.
+// why: 0 = top of image, 1 = obstacle, 2 = drop, 3 = no data
+
+void jhcTofNav::scan_col (const jhcTofCloud& cloud, int x)
+{
+  const float *w = cloud.World() + 3 * (9900 + x);
+  const float *r = cloud.Rot();
+  float dx, dy, rng, bx = 0.0f, by = 0.0f;
+  int y, run = 0;
+
+  // default bearing is ray through bottom pixel
+  dx = r[0] * cloud.RayX(9900 + x) + r[1] * cloud.RayY(9900 + x) + r[2];
+  dy = r[3] * cloud.RayX(9900 + x) + r[4] * cloud.RayY(9900 + x) + r[5];
+  fdist[x] = 0.0f;
+  odist[x] = 0.0f;
+  why[x] = 0;
+
+  // walk up column toward horizon
+  for (y = 99; y >= 0; y--, w -= 300)
+  {
+    // skip short runs of bad pixels
+    if ((w[0] == 0.0f) && (w[1] == 0.0f) && (w[2] == 0.0f))
+    {
+      if (++run > gap)
+      {
+        why[x] = 3;
+        break;
+      }
+      continue;
+    }
+    run = 0;
+    bx = w[0] - cloud.cx;
+    by = w[1] - cloud.cy;
+    rng = sqrtf(bx * bx + by * by);
+
+    // overhead things do not block robot
+    if (w[2] >= hmax)
+      continue;
+
+    // stop at tall things or holes
+    if ((w[2] > hobs) || (w[2] < -drop))
+    {
+      odist[x] = rng;
+      why[x] = ((w[2] > hobs) ? 1 : 2);
+      break;
+    }
+
+    // extend free distance with floor
+    if (rng > fdist[x])
+    {
+      fdist[x] = rng;
+      dx = bx;
+      dy = by;
+    }
+  }
+
+  // point toward blockage if no floor seen
+  if ((fdist[x] <= 0.0f) && (why[x] > 0) && (why[x] < 3))
+  {
+    dx = bx;
+    dy = by;
+  }
+  bear[x] = (float)(atan2(dx, dy) * 57.29578);
+}
+
+
+//= Minimum free distance over columns with bearings between "lf" and "rt".
+// bearings in degrees with positive to right of world Y axis
+// returns -1 if no columns in range
+
+float jhcTofNav::Corridor (float lf, float rt) const
+{
+  float lo = ((lf < rt) ? lf : rt), hi = ((lf < rt) ? rt : lf), best = -1.0f;
+  int x;
+
+  for (x = 0; x < 100; x++)
+    if ((bear[x] >= lo) && (bear[x] <= hi))
+      if ((best < 0.0f) || (fdist[x] < best))
+        best = fdist[x];
+  return best;
+}
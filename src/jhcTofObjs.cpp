@@ -0,0 +1,491 @@
+// jhcTofObjs.cpp : finds objects above support plane and measures their size
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jhcTofObjs.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofObjs::jhcTofObjs ()
+{
+  // plane fitting
+  iter = 50;                           // RANSAC trials
+  step = 3;                            // sample every Nth pixel
+  ptol = 10.0f;                        // max plane deviation (mm)
+
+  // object finding
+  hmin = 15.0f;                        // min height above plane (mm)
+  dstep = 30.0f;                       // max depth step within object (mm)
+  amin = 20;                           // min object size (pixels)
+
+  // no data yet
+  memset(hgt, 0, sizeof(hgt));
+  memset(lab, 0, sizeof(lab));
+  pn[0] = 0.0f;
+  pn[1] = -1.0f;
+  pn[2] = 0.0f;
+  pd = 0.0f;
+  pok = 0;
+  nobj = 0;
+  seed = 1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Find support plane then measure all objects sitting on it.
+// uses camera frame points and depth image from jhcTofCloud
+// returns number of objects found (0 if no plane)
+
+int jhcTofObjs::Analyze (const jhcTofCloud& cloud)
+{
+  nobj = 0;
+  if (FitPlane(cloud) <= 0)
+  {
+    memset(hgt, 0, sizeof(hgt));
+    memset(lab, 0, sizeof(lab));
+    return 0;
+  }
+  heights(cloud.Cam());
+  components(cloud.Depth(0));
+  measure(cloud);
+  return nobj;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                            Plane Fitting                              //
+///////////////////////////////////////////////////////////////////////////
+
+//= Find dominant plane in cloud, oriented so camera is on positive side.
+// tries planes through random point triples on a coarse grid of pixels
+// then does least squares fit to all full resolution inliers (twice)
+// returns number of inliers, 0 if no plane found
+
+int jhcTofObjs::FitPlane (const jhcTofCloud& cloud)
+{
+  const float *pts = cloud.Cam();
+  float n[3];
+  float d;
+  int x, y, i, cnt, ns = 0, best = 0;
+
+  // collect valid sample points
+  pok = 0;
+  for (y = step >> 1; y < 100; y += step)
+    for (x = step >> 1; x < 100; x += step)
+    {
+      i = 100 * y + x;
+      if (pts[3 * i + 2] > 0.0f)
+        samp[ns++] = i;
+    }
+  if (ns < 3)
+    return 0;
+
+  // try planes through random triples (repeatable sequence)
+  seed = 1;
+  for (i = 0; i < iter; i++)
+  {
+    if (plane_3pt(n, d, pts, samp[rnd() % ns], samp[rnd() % ns], samp[rnd() % ns]) <= 0)
+      continue;
+    if ((cnt = inliers(n, d, pts, ns)) <= best)
+      continue;
+    best = cnt;
+    memcpy(pn, n, sizeof(pn));
+    pd = d;
+  }
+  if (best < 3)
+    return 0;
+
+  // polish with all points near the plane
+  if (refine(pts) < 3)
+    return 0;
+  pok = refine(pts);
+  return pok;
+}
+
+
+//= Get plane through three sample points in camera frame.
+// normal is unit length and "d" is positive (camera above plane)
+// returns 1 if okay, 0 if points are nearly collinear
+
+int jhcTofObjs::plane_3pt (float *n, float& d, const float *pts, int a, int b, int c) const
+{
+  const float *pa = pts + 3 * a, *pb = pts + 3 * b, *pc = pts + 3 * c;
+  float ux = pb[0] - pa[0], uy = pb[1] - pa[1], uz = pb[2] - pa[2];
+  float vx = pc[0] - pa[0], vy = pc[1] - pa[1], vz = pc[2] - pa[2];
+  float len;
+
+  // normal is cross product of two edges
+  n[0] = uy * vz - uz * vy;
+  n[1] = uz * vx - ux * vz;
+  n[2] = ux * vy - uy * vx;
+  len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  if (len < 1.0f)
+    return 0;
+
+  // normalize and point toward camera
+  len = 1.0f / len;
+  n[0] *= len;
+  n[1] *= len;
+  n[2] *= len;
+  d = -(n[0] * pa[0] + n[1] * pa[1] + n[2] * pa[2]);
+  if (d < 0.0f)
+  {
+    n[0] = -n[0];
+    n[1] = -n[1];
+    n[2] = -n[2];
+    d = -d;
+  }
+  return 1;
+}
+
+
+//= Count how many sample points are within "ptol" of plane.
+
+int jhcTofObjs::inliers (const float *n, float d, const float *pts, int ns) const
+{
+  const float *p;
+  float h;
+  int i, cnt = 0;
+
+  for (i = 0; i < ns; i++)
+  {
+    p = pts + 3 * samp[i];
+    h = n[0] * p[0] + n[1] * p[1] + n[2] * p[2] + d;
+    if ((h <= ptol) && (h >= -ptol))
+      cnt++;
+  }
+  return cnt;
+}
+
+
+//= Least squares fit of plane to all valid points near current plane.
+// normal is direction of least scatter (uses largest 2x2 cofactor)
+// returns number of points used, plane unchanged if too few
+
+int jhcTofObjs::refine (const float *pts)
+{
+  double m[10];
+  const float *p = pts;
+  float h;
+  int i;
+
+  // gather statistics of inliers
+  memset(m, 0, sizeof(m));
+  for (i = 0; i < 10000; i++, p += 3)
+  {
+    if (p[2] <= 0.0f)
+      continue;
+    h = pn[0] * p[0] + pn[1] * p[1] + pn[2] * p[2] + pd;
+    if ((h > ptol) || (h < -ptol))
+      continue;
+    jhcTofCloud::AddMoments(m, p);
+  }
+
+  // replace plane if enough points and not degenerate
+  if (jhcTofCloud::FitPlane(pn, pd, m) < 0.0f)
+    return((m[0] < 3.0) ? (int) m[0] : 0);
+  return (int) m[0];
+}
+
+
+//= Simple repeatable pseudo-random number (0 to 32767).
+
+unsigned int jhcTofObjs::rnd ()
+{
+  seed = seed * 1103515245 + 12345;
+  return((seed >> 16) & 0x7FFF);
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                            Object Finding                             //
+///////////////////////////////////////////////////////////////////////////
+
+//= Compute height of each valid point above support plane (mm).
+// invalid pixels get zero height
+
+void jhcTofObjs::heights (const float *pts)
+{
+  const float *p = pts;
+  float h;
+  int i;
+
+  for (i = 0; i < 10000; i++, p += 3)
+  {
+    if (p[2] <= 0.0f)
+    {
+      hgt[i] = 0;
+      continue;
+    }
+    h = pn[0] * p[0] + pn[1] * p[1] + pn[2] * p[2] + pd;
+    h = ((h <= -32767.0f) ? -32767.0f : ((h < 32767.0f) ? h : 32767.0f));
+    hgt[i] = (short)((h >= 0.0f) ? h + 0.5f : h - 0.5f);
+  }
+}
+
+
+//= Label 4-connected regions of pixels at least "hmin" above plane.
+// neighbors must also have depths within "dstep" of each other
+// drops regions smaller than "amin" and keeps at most 100 objects
+// returns number of objects found
+
+int jhcTofObjs::components (const unsigned short *dep)
+{
+  int x, y, i, a, b, ra, rb, tol = (int)(4.0f * dstep + 0.5f), hlim = (int)(hmin + 0.5f);
+  int cnt[10001];                      // every pixel might be a new label
+  int n = 0;
+
+  // first pass gives provisional labels and records equivalences
+  for (y = 0, i = 0; y < 100; y++)
+    for (x = 0; x < 100; x++, i++)
+    {
+      lab[i] = 0;
+      if (hgt[i] < hlim)
+        continue;
+      a = 0;
+      b = 0;
+      if ((x > 0) && (lab[i - 1] > 0) && (abs(dep[i] - dep[i - 1]) <= tol))
+        a = lab[i - 1];
+      if ((y > 0) && (lab[i - 100] > 0) && (abs(dep[i] - dep[i - 100]) <= tol))
+        b = lab[i - 100];
+      if ((a <= 0) && (b <= 0))
+      {
+        lab[i] = (unsigned short)(++n);
+        par[n] = (unsigned short) n;
+        continue;
+      }
+      if ((a <= 0) || (b <= 0))
+      {
+        lab[i] = (unsigned short)((a > 0) ? a : b);
+        continue;
+      }
+      ra = root(a);
+      rb = root(b);
+      if (ra < rb)
+        par[rb] = (unsigned short) ra;
+      else
+        par[ra] = (unsigned short) rb;
+      lab[i] = (unsigned short)((ra < rb) ? ra : rb);
+    }
+
+  // count pixels in each merged region
+  for (a = 1; a <= n; a++)
+    cnt[a] = 0;
+  for (i = 0; i < 10000; i++)
+    if (lab[i] > 0)
+    {
+      lab[i] = (unsigned short) root(lab[i]);
+      cnt[lab[i]] += 1;
+    }
+
+  // assign final object numbers to big enough regions
+  nobj = 0;
+  for (a = 1; a <= n; a++)
+    if ((par[a] == a) && (cnt[a] >= amin) && (nobj < 100))
+      cnt[a] = ++nobj;
+    else
+      cnt[a] = 0;
+  for (i = 0; i < 10000; i++)
+    if (lab[i] > 0)
+      lab[i] = (unsigned short) cnt[lab[i]];
+  return nobj;
+}
+
+
+//= Find representative label for equivalence class (with path halving).
+
+int jhcTofObjs::root (int i)
+{
+  while (par[i] != i)
+  {
+    par[i] = par[par[i]];
+    i = par[i];
+  }
+  return i;
+}
+
+
+//= Get volume, footprint, and max height of all objects in one pass.
+// ground area of pixel is z^2 * (sx * sy) / |ray . n| for unit normal n
+// where ray is (x/z, y/z, 1) from lookup table in cloud
+
+void jhcTofObjs::measure (const jhcTofCloud& cloud)
+{
+  const float *p = cloud.Cam();
+  float sxy = cloud.asp / (cloud.flen * cloud.flen);
+  float z, h, w, dot;
+  int i, k;
+
+  // clear accumulators
+  for (k = 0; k < nobj; k++)
+  {
+    vol[k] = 0.0f;
+    area[k] = 0.0f;
+    tall[k] = 0.0f;
+    npix[k] = 0;
+  }
+
+  // integrate over labelled pixels
+  for (i = 0; i < 10000; i++, p += 3)
+  {
+    if ((k = lab[i] - 1) < 0)
+      continue;
+    z = p[2];
+    h = (float) hgt[i];
+    dot = fabsf(pn[0] * cloud.RayX(i) + pn[1] * cloud.RayY(i) + pn[2]);
+    w = sxy * z * z / ((dot > 0.05f) ? dot : 0.05f);
+    area[k] += w;
+    vol[k] += w * h;
+    tall[k] = ((h > tall[k]) ? h : tall[k]);
+    npix[k]++;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                          Footprint Geometry                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Build orthonormal in-plane axes "u" and "v" with camera x roughly along "u".
+// uses camera y instead if plane is seen nearly edge-on along x
+// together with plane normal these form a right-handed set
+
+void jhcTofObjs::PlaneAxes (float *u, float *v) const
+{
+  const float *n = pn;
+  float len;
+  int i;
+
+  // camera x axis with normal component removed
+  u[0] = 1.0f - n[0] * n[0];
+  u[1] = -n[0] * n[1];
+  u[2] = -n[0] * n[2];
+  len = sqrtf(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+  if (len < 0.1f)
+  {
+    // normal nearly along camera x so use camera y instead
+    u[0] = -n[1] * n[0];
+    u[1] = 1.0f - n[1] * n[1];
+    u[2] = -n[1] * n[2];
+    len = sqrtf(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+  }
+  for (i = 0; i < 3; i++)
+    u[i] /= len;
+
+  // third axis completes right-handed set
+  v[0] = n[1] * u[2] - n[2] * u[1];
+  v[1] = n[2] * u[0] - n[0] * u[2];
+  v[2] = n[0] * u[1] - n[1] * u[0];
+}
+
+
+//= Find oriented bounding box of each object footprint in plane axes "u" and "v".
+// "dir" is major principal axis, "ctr" is middle of box (not centroid)
+// "size" is full length along major axis then along minor axis
+
+void jhcTofObjs::Extents (float (*ctr)[2], float (*dir)[2], float (*size)[2],
+                          const float *u, const float *v, const jhcTofCloud& cloud) const
+{
+  double s[100][6];
+  float lo1[100], hi1[100], lo2[100], hi2[100];
+  const float *p = cloud.Cam();
+  double a, b, aa, ab, bb;
+  float da, db, s1, s2, m1, m2;
+  int i, k, j;
+
+  // clear accumulators
+  for (k = 0; k < nobj; k++)
+  {
+    for (j = 0; j < 6; j++)
+      s[k][j] = 0.0;
+    lo1[k] = 0.0f;
+    hi1[k] = 0.0f;
+    lo2[k] = 0.0f;
+    hi2[k] = 0.0f;
+  }
+
+  // gather footprint moments in plane coordinates
+  for (i = 0; i < 10000; i++, p += 3)
+  {
+    if ((k = lab[i] - 1) < 0)
+      continue;
+    a = u[0] * p[0] + u[1] * p[1] + u[2] * p[2];
+    b = v[0] * p[0] + v[1] * p[1] + v[2] * p[2];
+    s[k][0] += 1.0;
+    s[k][1] += a;
+    s[k][2] += b;
+    s[k][3] += a * a;
+    s[k][4] += a * b;
+    s[k][5] += b * b;
+  }
+
+  // centroid and major axis direction
+  for (k = 0; k < nobj; k++)
+  {
+    ctr[k][0] = (float)(s[k][1] / s[k][0]);
+    ctr[k][1] = (float)(s[k][2] / s[k][0]);
+    aa = s[k][3] / s[k][0] - ctr[k][0] * ctr[k][0];
+    ab = s[k][4] / s[k][0] - ctr[k][0] * ctr[k][1];
+    bb = s[k][5] / s[k][0] - ctr[k][1] * ctr[k][1];
+    a = 0.5 * atan2(2.0 * ab, aa - bb);
+    dir[k][0] = (float) cos(a);
+    dir[k][1] = (float) sin(a);
+  }
+
+  // project footprint onto major and minor axes
+  p = cloud.Cam();
+  for (i = 0; i < 10000; i++, p += 3)
+  {
+    if ((k = lab[i] - 1) < 0)
+      continue;
+    da = u[0] * p[0] + u[1] * p[1] + u[2] * p[2] - ctr[k][0];
+    db = v[0] * p[0] + v[1] * p[1] + v[2] * p[2] - ctr[k][1];
+    s1 = da * dir[k][0] + db * dir[k][1];
+    s2 = db * dir[k][0] - da * dir[k][1];
+    lo1[k] = ((s1 < lo1[k]) ? s1 : lo1[k]);
+    hi1[k] = ((s1 > hi1[k]) ? s1 : hi1[k]);
+    lo2[k] = ((s2 < lo2[k]) ? s2 : lo2[k]);
+    hi2[k] = ((s2 > hi2[k]) ? s2 : hi2[k]);
+  }
+
+  // save sizes and recenter
+  for (k = 0; k < nobj; k++)
+  {
+    size[k][0] = hi1[k] - lo1[k];
+    size[k][1] = hi2[k] - lo2[k];
+    m1 = 0.5f * (lo1[k] + hi1[k]);
+    m2 = 0.5f * (lo2[k] + hi2[k]);
+    ctr[k][0] += m1 * dir[k][0] - m2 * dir[k][1];
+    ctr[k][1] += m1 * dir[k][1] + m2 * dir[k][0];
+  }
+}
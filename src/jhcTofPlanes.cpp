@@ -0,0 +1,326 @@
+// jhcTofPlanes.cpp : finds all large planar surfaces in TOF point cloud
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <jhcTofPlanes.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofPlanes::jhcTofPlanes ()
+{
+  // block flatness
+  dabs = 20.0f;                        // always allowed depth step (mm)
+  dfrac = 0.05f;                       // extra step per unit depth
+  eabs = 1.5f;                         // always allowed rms error (mm)
+  efrac = 0.004f;                      // extra error per unit depth
+
+  // region growing
+  ang = 15.0f;                         // max normal difference (degs)
+  bmin = 6;                            // min plane size (blocks)
+
+  // pixel assignment
+  pabs = 5.0f;                         // always allowed distance (mm)
+  pfrac = 0.01f;                       // extra distance per unit depth
+
+  // no data yet
+  memset(lab, 0, sizeof(lab));
+  nblk = 0;
+  np = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Find all big planes in camera frame cloud and label their pixels.
+// returns number of planes found
+
+int jhcTofPlanes::Analyze (const jhcTofCloud& cloud)
+{
+  const float *pts = cloud.Cam();
+
+  fit_blocks(pts);
+  if (grow_regions() > 0)
+  {
+    assign_pixels(pts);
+    refit_planes(pts);
+  }
+  else
+    memset(lab, 0, sizeof(lab));
+  return np;
+}
+
+
+//= Fit a plane to each 5 x 5 block and sort flat ones by rms error.
+// only blocks with all pixels valid and no depth jumps are considered
+
+void jhcTofPlanes::fit_blocks (const float *pts)
+{
+  const float *p;
+  int bx, by, x, y, j, b = 0;
+
+  nblk = 0;
+  for (by = 0; by < 20; by++)
+    for (bx = 0; bx < 20; bx++, b++)
+    {
+      // accumulate moments of complete smooth blocks
+      blab[b] = -1;
+      if (block_ok(pts, bx, by) <= 0)
+        continue;
+      memset(bsum[b], 0, 10 * sizeof(double));
+      for (y = 0; y < 5; y++)
+      {
+        p = pts + 3 * (100 * (5 * by + y) + 5 * bx);
+        for (x = 0; x < 5; x++, p += 3)
+          jhcTofCloud::AddMoments(bsum[b], p);
+      }
+
+      // reject if too rough, else insert in sorted list
+      brms[b] = jhcTofCloud::FitPlane(bn[b], bd[b], bsum[b]);
+      if ((brms[b] < 0.0f) ||
+          (brms[b] > tol((float)(bsum[b][3] / bsum[b][0]), eabs, efrac)))
+        continue;
+      blab[b] = 0;
+      for (j = nblk; (j > 0) && (brms[order[j - 1]] > brms[b]); j--)
+        order[j] = order[j - 1];
+      order[j] = b;
+      nblk++;
+    }
+}
+
+
+//= Check that all block pixels are valid with no big steps between them.
+
+int jhcTofPlanes::block_ok (const float *pts, int bx, int by) const
+{
+  const float *p;
+  float z, z0, lim;
+  int x, y;
+
+  for (y = 0; y < 5; y++)
+  {
+    p = pts + 3 * (100 * (5 * by + y) + 5 * bx) + 2;
+    for (x = 0; x < 5; x++, p += 3)
+    {
+      if ((z = *p) <= 0.0f)
+        return 0;
+      lim = tol(z, dabs, dfrac);
+      if ((x > 0) && (((z0 = p[-3]) > z + lim) || (z0 < z - lim)))
+        return 0;
+      if ((y > 0) && (((z0 = p[-300]) > z + lim) || (z0 < z - lim)))
+        return 0;
+    }
+  }
+  return 1;
+}
+
+
+//= Grow regions of similar blocks starting with the flattest ones.
+// regions too small are released so their blocks can join others
+// returns number of planes found
+
+int jhcTofPlanes::grow_regions ()
+{
+  int i, b, cnt;
+
+  np = 0;
+  for (i = 0; (i < nblk) && (np < 50); i++)
+  {
+    b = order[i];
+    if (blab[b] != 0)
+      continue;
+    if ((cnt = grow(b, np + 1)) >= bmin)
+    {
+      // save merged region plane for pixel assignment
+      memcpy(pn[np], rn, 3 * sizeof(float));
+      pd[np] = rd;
+      np++;
+    }
+    else
+      while (--cnt >= 0)
+        blab[queue[cnt]] = 0;
+  }
+
+  return np;
+}
+
+
+//= Breadth-first growth from "seed" block giving each member label "n".
+// adds 4-connected block if its normal is close and combined fit stays good
+// leaves members in queue and region plane in rn and rd
+// returns number of blocks in region
+
+int jhcTofPlanes::grow (int seed, int n)
+{
+  double s[10];
+  float n2[3];
+  float d2, e, c = (float) cos(ang * 0.0174533), z;
+  int nb[4];
+  int i, j, k, b, bx, by, head = 0, tail = 1;
+
+  // start with seed block alone
+  memcpy(rsum, bsum[seed], 10 * sizeof(double));
+  memcpy(rn, bn[seed], 3 * sizeof(float));
+  rd = bd[seed];
+  blab[seed] = n;
+  queue[0] = seed;
+
+  // examine neighbors of each region member in turn
+  while (head < tail)
+  {
+    b = queue[head++];
+    bx = b % 20;
+    by = b / 20;
+    nb[0] = ((bx > 0)  ? b - 1  : -1);
+    nb[1] = ((bx < 19) ? b + 1  : -1);
+    nb[2] = ((by > 0)  ? b - 20 : -1);
+    nb[3] = ((by < 19) ? b + 20 : -1);
+    for (j = 0; j < 4; j++)
+    {
+      // block must be flat, unclaimed, and similarly oriented
+      if (((k = nb[j]) < 0) || (blab[k] != 0))
+        continue;
+      if (rn[0] * bn[k][0] + rn[1] * bn[k][1] + rn[2] * bn[k][2] < c)
+        continue;
+
+      // combined plane must still fit well
+      for (i = 0; i < 10; i++)
+        s[i] = rsum[i] + bsum[k][i];
+      z = (float)(s[3] / s[0]);
+      if (((e = jhcTofCloud::FitPlane(n2, d2, s)) < 0.0f) || (e > tol(z, eabs, efrac)))
+        continue;
+
+      // accept block and update region plane
+      memcpy(rsum, s, 10 * sizeof(double));
+      memcpy(rn, n2, 3 * sizeof(float));
+      rd = d2;
+      blab[k] = n;
+      queue[tail++] = k;
+    }
+  }
+  return tail;
+}
+
+
+//= Give each valid pixel the label of the closest nearby plane.
+// candidates are planes of the pixel's block and its 8 neighbors
+
+void jhcTofPlanes::assign_pixels (const float *pts)
+{
+  int cand[9];
+  const float *p = pts, *n;
+  float h, best, lim;
+  int x, y, bx, by, dx, dy, j, k, nc, win, i = 0;
+
+  for (y = 0; y < 100; y++)
+    for (x = 0; x < 100; x++, i++, p += 3)
+    {
+      lab[i] = 0;
+      if (p[2] <= 0.0f)
+        continue;
+
+      // collect distinct plane labels around block
+      bx = x / 5;
+      by = y / 5;
+      nc = 0;
+      for (dy = -1; dy <= 1; dy++)
+        for (dx = -1; dx <= 1; dx++)
+        {
+          if ((bx + dx < 0) || (bx + dx > 19) || (by + dy < 0) || (by + dy > 19))
+            continue;
+          if ((k = blab[20 * (by + dy) + bx + dx]) <= 0)
+            continue;
+          for (j = 0; j < nc; j++)
+            if (cand[j] == k)
+              break;
+          if (j >= nc)
+            cand[nc++] = k;
+        }
+
+      // pick closest plane if near enough
+      lim = tol(p[2], pabs, pfrac);
+      best = lim;
+      win = 0;
+      for (j = 0; j < nc; j++)
+      {
+        n = pn[cand[j] - 1];
+        h = (float) fabs(n[0] * p[0] + n[1] * p[1] + n[2] * p[2] + pd[cand[j] - 1]);
+        if (h <= best)
+        {
+          best = h;
+          win = cand[j];
+        }
+      }
+      lab[i] = (unsigned short) win;
+    }
+}
+
+
+//= Least squares fit of each plane to all of its assigned pixels.
+// planes left with too few pixels (or degenerate) are removed and
+// remaining planes and pixel labels are renumbered consecutively
+
+void jhcTofPlanes::refit_planes (const float *pts)
+{
+  double psum[50][10];
+  int map[51];
+  const float *p = pts;
+  float e;
+  int i, k, n = 0;
+
+  // gather statistics of pixels assigned to each plane
+  memset(psum, 0, sizeof(psum));
+  for (i = 0; i < 10000; i++, p += 3)
+    if ((k = lab[i]) > 0)
+      jhcTofCloud::AddMoments(psum[k - 1], p);
+
+  // keep only planes with a valid fit (compacting arrays)
+  map[0] = 0;
+  for (k = 0; k < np; k++)
+  {
+    map[k + 1] = 0;
+    if ((e = jhcTofCloud::FitPlane(pn[n], pd[n], psum[k])) < 0.0f)
+      continue;
+    prms[n] = e;
+    npix[n] = (int) psum[k][0];
+    map[k + 1] = ++n;
+  }
+  if (n >= np)
+    return;
+
+  // renumber pixel and block labels
+  np = n;
+  for (i = 0; i < 10000; i++)
+    lab[i] = (unsigned short) map[lab[i]];
+  for (i = 0; i < 400; i++)
+    if (blab[i] > 0)
+      blab[i] = map[blab[i]];
+}
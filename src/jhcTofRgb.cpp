@@ -0,0 +1,256 @@
+// jhcTofRgb.cpp : registers depth image into an external RGB camera
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <string.h>
+
+#include <jhcTofRgb.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Destructor cleans up any allocated items.
+
+jhcTofRgb::~jhcTofRgb ()
+{
+  delete [] zbuf;
+}
+
+
+//= Default constructor initializes certain values.
+
+jhcTofRgb::jhcTofRgb ()
+{
+  int i;
+
+  // typical 640x480 webcam with 60 degree horizontal view
+  rw = 640;                            // image width (pixels)
+  rh = 480;                            // image height (pixels)
+  fx = 554.3f;                         // focal length along columns
+  fy = 554.3f;                         // focal length along rows
+  ppx = 319.5f;                        // principal point column
+  ppy = 239.5f;                        // principal point row
+  k1 = 0.0f;                           // radial distortion r^2 term
+  k2 = 0.0f;                           // radial distortion r^4 term
+
+  // co-located with depth camera by default
+  for (i = 0; i < 9; i++)
+    rot[i] = (((i % 4) == 0) ? 1.0f : 0.0f);
+  shift[0] = 0.0f;
+  shift[1] = 0.0f;
+  shift[2] = 0.0f;
+
+  // depth camera and surface continuity
+  flen = 85.7f;                        // focal length along rows
+  asp = 1.21f;                         // x scale factor for columns
+  jump = 0.05f;                        // max depth spread in triangle
+
+  // no lookup table or image yet
+  zbuf = NULL;
+  w = 0;
+  h = 0;
+  nz = 0;
+  ready = 0;
+}
+
+
+//= Rotate each depth ray into RGB frame and make sure image is right size.
+// returns 1 if okay, 0 if bad RGB image size
+
+int jhcTofRgb::build_lut ()
+{
+  float sx = asp / flen, sy = 1.0f / flen, rx, ry;
+  float *d = dir;
+  int x, y;
+
+  // resize output if needed
+  if ((rw <= 0) || (rh <= 0))
+    return 0;
+  if ((rw != w) || (rh != h))
+  {
+    delete [] zbuf;
+    zbuf = new unsigned short [rw * rh];
+    w = rw;
+    h = rh;
+  }
+
+  // rotated rays for z = 1 in depth camera
+  for (y = 0; y < 100; y++)
+    for (x = 0; x < 100; x++, d += 3)
+    {
+      rx = sx * (x - 49.5f);
+      ry = sy * (y - 49.5f);
+      d[0] = rot[0] * rx + rot[1] * ry + rot[2];
+      d[1] = rot[3] * rx + rot[4] * ry + rot[5];
+      d[2] = rot[6] * rx + rot[7] * ry + rot[8];
+    }
+  ready = 1;
+  return 1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Make depth image aligned with RGB camera from 16 bit range image.
+// takes pointer from jhcTofCam::Range (0.25mm units, 65535 = invalid)
+// returns number of RGB pixels with known depth
+
+int jhcTofRgb::Register (const unsigned char *range)
+{
+  const unsigned short *z;
+  int x, y, i, n;
+
+  // set up lookup table and blank output
+  nz = 0;
+  if (range == NULL)
+    return 0;
+  if ((ready <= 0) && (build_lut() <= 0))
+    return 0;
+  n = w * h;
+  memset(zbuf, 0xFF, n * sizeof(unsigned short));
+
+  // project all pixels then fill triangles between them
+  project((const unsigned short *) range);
+  for (y = 0; y < 99; y++)
+    for (x = 0; x < 99; x++)
+    {
+      i = 100 * y + x;
+      tri(i, i + 1, i + 100);
+      tri(i + 1, i + 101, i + 100);
+    }
+
+  // count known pixels
+  for (z = zbuf, i = 0; i < n; i++, z++)
+    if (*z != 65535)
+      nz++;
+  return nz;
+}
+
+
+//= Find RGB image position and inverse RGB depth for each valid depth pixel.
+
+void jhcTofRgb::project (const unsigned short *d)
+{
+  const float *r = dir;
+  float z, px, py, pz, xn, yn, r2, f;
+  int i;
+
+  for (i = 0; i < 10000; i++, d++, r += 3)
+  {
+    // point in RGB camera frame (mm)
+    ok[i] = 0;
+    if ((*d == 0) || (*d == 65535))
+      continue;
+    z = 0.25f * (*d);
+    px = z * r[0] + shift[0];
+    py = z * r[1] + shift[1];
+    pz = z * r[2] + shift[2];
+    if (pz <= 1.0f)
+      continue;
+
+    // normalized image coordinates with optional radial distortion
+    iz[i] = 1.0f / pz;
+    xn = px * iz[i];
+    yn = py * iz[i];
+    if ((k1 != 0.0f) || (k2 != 0.0f))
+    {
+      r2 = xn * xn + yn * yn;
+      f = 1.0f + r2 * (k1 + r2 * k2);
+      xn *= f;
+      yn *= f;
+    }
+    pu[i] = fx * xn + ppx;
+    pv[i] = fy * yn + ppy;
+    ok[i] = 1;
+  }
+}
+
+
+//= Fill RGB pixels whose centers are inside triangle of depth pixels "a", "b", "c".
+// interpolates inverse depth (exact for planar patch) and keeps closest value
+
+void jhcTofRgb::tri (int a, int b, int c)
+{
+  float ua = pu[a], va = pv[a], ub = pu[b], vb = pv[b], uc = pu[c], vc = pv[c];
+  float za, zb, zc, zlo, zhi, lo, hi, area, inv, du0, du1, w0, w1, iv;
+  int u0, u1, v0, v1, u, v, val;
+  unsigned short *row;
+
+  // skip if some corner missing or surface not continuous
+  if ((ok[a] <= 0) || (ok[b] <= 0) || (ok[c] <= 0))
+    return;
+  za = 1.0f / iz[a];
+  zb = 1.0f / iz[b];
+  zc = 1.0f / iz[c];
+  zlo = ((za < zb) ? za : zb);
+  zlo = ((zc < zlo) ? zc : zlo);
+  zhi = ((za > zb) ? za : zb);
+  zhi = ((zc > zhi) ? zc : zhi);
+  if ((zhi - zlo) > jump * zlo)
+    return;
+
+  // RGB pixel centers covered by bounding box
+  lo = ((ua < ub) ? ua : ub);
+  lo = ((uc < lo) ? uc : lo);
+  hi = ((ua > ub) ? ua : ub);
+  hi = ((uc > hi) ? uc : hi);
+  u0 = ((lo > 0.0f) ? (int) ceilf(lo) : 0);
+  u1 = ((hi < w - 1) ? (int) floorf(hi) : w - 1);
+  lo = ((va < vb) ? va : vb);
+  lo = ((vc < lo) ? vc : lo);
+  hi = ((va > vb) ? va : vb);
+  hi = ((vc > hi) ? vc : hi);
+  v0 = ((lo > 0.0f) ? (int) ceilf(lo) : 0);
+  v1 = ((hi < h - 1) ? (int) floorf(hi) : h - 1);
+  if ((u0 > u1) || (v0 > v1))
+    return;
+
+  // barycentric weights of a and b change linearly across row
+  area = (ub - ua) * (vc - va) - (uc - ua) * (vb - va);
+  if ((area < 1e-6f) && (area > -1e-6f))
+    return;
+  inv = 1.0f / area;
+  du0 = (vb - vc) * inv;
+  du1 = (vc - va) * inv;
+
+  // scan each row keeping closest surface
+  for (v = v0; v <= v1; v++)
+  {
+    w0 = ((ub - u0) * (vc - v) - (uc - u0) * (vb - v)) * inv;
+    w1 = ((uc - u0) * (va - v) - (ua - u0) * (vc - v)) * inv;
+    row = zbuf + v * w;
+    for (u = u0; u <= u1; u++, w0 += du0, w1 += du1)
+    {
+      if ((w0 < -1e-5f) || (w1 < -1e-5f) || (w0 + w1 > 1.00001f))
+        continue;
+      iv = w0 * iz[a] + w1 * iz[b] + (1.0f - w0 - w1) * iz[c];
+      val = (int)(4.0f / iv + 0.5f);
+      val = ((val < 65534) ? val : 65534);
+      if (val < row[u])
+        row[u] = (unsigned short) val;
+    }
+  }
+}
@@ -0,0 +1,410 @@
+// jhcTofShape.cpp : fits box and cylinder primitives to objects on support plane
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+
+#include <jhcTofShape.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Default constructor initializes certain values.
+
+jhcTofShape::jhcTofShape ()
+{
+  tfrac = 0.7f;                        // top surface part of max height
+  bias = 1.1f;                         // box okay if error within 10%
+  nobj = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Fit both primitives to every object from last call to objs.Analyze.
+// picks box unless cylinder residual is clearly smaller
+// returns number of objects fit
+
+int jhcTofShape::Analyze (const jhcTofObjs& objs, const jhcTofCloud& cloud)
+{
+  int k;
+
+  nobj = 0;
+  if ((objs.Plane() <= 0) || (objs.Count() <= 0))
+    return 0;
+  nobj = objs.Count();
+  plane_axes(objs);
+  moments(objs, cloud);
+  box_extents(objs, cloud);
+  box_faces(objs, cloud);
+  residuals(objs, cloud);
+  for (k = 0; k < nobj; k++)
+    results(k);
+  return nobj;
+}
+
+
+//= Get plane coordinate system with normal pointing up toward camera.
+
+void jhcTofShape::plane_axes (const jhcTofObjs& objs)
+{
+  const float *n = objs.Normal();
+  int i;
+
+  for (i = 0; i < 3; i++)
+    nx[i] = n[i];
+  d0 = objs.Offset();
+  objs.PlaneAxes(ux, vx);
+}
+
+
+//= Get top height and least squares circle for each object.
+// circle uses side points and pixels on boundary of object in image
+
+void jhcTofShape::moments (const jhcTofObjs& objs, const jhcTofCloud& cloud)
+{
+  double c[100][9];
+  float sh[100];
+  int nh[100];
+  const unsigned short *lab = objs.Labels();
+  const short *hgt = objs.Height();
+  const float *p = cloud.Cam();
+  double a, b, w, det, dd, de, df;
+  int x, y, k, j, rim, i = 0;
+
+  // clear accumulators
+  for (k = 0; k < nobj; k++)
+  {
+    for (j = 0; j < 9; j++)
+      c[k][j] = 0.0;
+    sh[k] = 0.0f;
+    nh[k] = 0;
+  }
+
+  // gather circle statistics in plane coordinates
+  for (y = 0; y < 100; y++)
+    for (x = 0; x < 100; x++, i++, p += 3)
+    {
+      if ((k = lab[i] - 1) < 0)
+        continue;
+      a = ux[0] * p[0] + ux[1] * p[1] + ux[2] * p[2];
+      b = vx[0] * p[0] + vx[1] * p[1] + vx[2] * p[2];
+
+      // top surface or side
+      rim = 0;
+      if (hgt[i] >= tfrac * objs.MaxHt(k + 1))
+      {
+        sh[k] += hgt[i];
+        nh[k]++;
+        if ((x <= 0) || (x >= 99) || (y <= 0) || (y >= 99) ||
+            (lab[i - 1] != lab[i]) || (lab[i + 1] != lab[i]) ||
+            (lab[i - 100] != lab[i]) || (lab[i + 100] != lab[i]))
+          rim = 1;
+      }
+      else
+        rim = 1;
+      if (rim <= 0)
+        continue;
+
+      // points expected to lie on cylinder wall
+      w = a * a + b * b;
+      c[k][0] += 1.0;
+      c[k][1] += a;
+      c[k][2] += b;
+      c[k][3] += a * a;
+      c[k][4] += a * b;
+      c[k][5] += b * b;
+      c[k][6] += a * w;
+      c[k][7] += b * w;
+      c[k][8] += w;
+    }
+
+  // analyze each object
+  for (k = 0; k < nobj; k++)
+  {
+    bht[k] = ((nh[k] > 0) ? sh[k] / nh[k] : objs.MaxHt(k + 1));
+
+    // solve a^2 + b^2 + D a + E b + F = 0 by Cramer's rule
+    crad[k] = -1.0f;
+    if (c[k][0] < 5.0)
+      continue;
+    det = c[k][3] * (c[k][5] * c[k][0] - c[k][2] * c[k][2]) -
+          c[k][4] * (c[k][4] * c[k][0] - c[k][2] * c[k][1]) +
+          c[k][1] * (c[k][4] * c[k][2] - c[k][5] * c[k][1]);
+    if (fabs(det) < 1e-6)
+      continue;
+    dd = -(c[k][6] * (c[k][5] * c[k][0] - c[k][2] * c[k][2]) -
+           c[k][4] * (c[k][7] * c[k][0] - c[k][2] * c[k][8]) +
+           c[k][1] * (c[k][7] * c[k][2] - c[k][5] * c[k][8])) / det;
+    de = -(c[k][3] * (c[k][7] * c[k][0] - c[k][8] * c[k][2]) -
+           c[k][6] * (c[k][4] * c[k][0] - c[k][2] * c[k][1]) +
+           c[k][1] * (c[k][4] * c[k][8] - c[k][7] * c[k][1])) / det;
+    df = -(c[k][3] * (c[k][5] * c[k][8] - c[k][2] * c[k][7]) -
+           c[k][4] * (c[k][4] * c[k][8] - c[k][1] * c[k][7]) +
+           c[k][6] * (c[k][4] * c[k][2] - c[k][5] * c[k][1])) / det;
+    ca[k] = (float)(-0.5 * dd);
+    cb[k] = (float)(-0.5 * de);
+    if ((w = ca[k] * ca[k] + cb[k] * cb[k] - df) > 0.0)
+      crad[k] = (float) sqrt(w);
+  }
+}
+
+
+//= Find box center and half sizes from footprint extent along principal axes.
+// also supplies cylinder guess for objects where circle fit failed
+
+void jhcTofShape::box_extents (const jhcTofObjs& objs, const jhcTofCloud& cloud)
+{
+  float ctr[100][2], size[100][2];
+  int k;
+
+  objs.Extents(ctr, bdir, size, ux, vx, cloud);
+  for (k = 0; k < nobj; k++)
+  {
+    ba[k] = ctr[k][0];
+    bb[k] = ctr[k][1];
+    bhalf[k][0] = 0.5f * size[k][0];
+    bhalf[k][1] = 0.5f * size[k][1];
+    if (crad[k] < 0.0f)
+    {
+      ca[k] = ba[k];
+      cb[k] = bb[k];
+      crad[k] = 0.5f * (bhalf[k][0] + bhalf[k][1]);
+    }
+  }
+}
+
+
+//= Least squares adjustment of box faces using points nearest to each.
+// faces with too few points keep their previous position
+
+void jhcTofShape::box_faces (const jhcTofObjs& objs, const jhcTofCloud& cloud)
+{
+  float fs[100][5];
+  int fn[100][5];
+  const unsigned short *lab = objs.Labels();
+  const short *hgt = objs.Height();
+  const float *p = cloud.Cam();
+  float off[5];
+  float a, b, h, s1, s2, e, best, lo, hi, mid;
+  int i, j, k, f;
+
+  // clear accumulators
+  for (k = 0; k < nobj; k++)
+    for (j = 0; j < 5; j++)
+    {
+      fs[k][j] = 0.0f;
+      fn[k][j] = 0;
+    }
+
+  // assign each point to closest face: +s1, -s1, +s2, -s2, top
+  for (i = 0; i < 10000; i++, p += 3)
+  {
+    if ((k = lab[i] - 1) < 0)
+      continue;
+    a = ux[0] * p[0] + ux[1] * p[1] + ux[2] * p[2];
+    b = vx[0] * p[0] + vx[1] * p[1] + vx[2] * p[2];
+    h = hgt[i];
+    box_local(s1, s2, k, a, b);
+    off[0] = s1;
+    off[1] = s1;
+    off[2] = s2;
+    off[3] = s2;
+    off[4] = h;
+    best = fabsf(h - bht[k]);
+    f = 4;
+    for (j = 0; j < 4; j++)
+    {
+      e = fabsf(off[j] - (((j & 1) == 0) ? bhalf[k][j >> 1] : -bhalf[k][j >> 1]));
+      if (e < best)
+      {
+        best = e;
+        f = j;
+      }
+    }
+    fs[k][f] += off[f];
+    fn[k][f]++;
+  }
+
+  // move each well supported face to mean of its points
+  for (k = 0; k < nobj; k++)
+  {
+    for (j = 0; j < 4; j += 2)
+    {
+      hi = ((fn[k][j] >= 3) ? fs[k][j] / fn[k][j] : bhalf[k][j >> 1]);
+      lo = ((fn[k][j + 1] >= 3) ? fs[k][j + 1] / fn[k][j + 1] : -bhalf[k][j >> 1]);
+      if (hi <= lo)
+        continue;
+      mid = 0.5f * (hi + lo);
+      bhalf[k][j >> 1] = 0.5f * (hi - lo);
+      if (j == 0)
+      {
+        ba[k] += mid * bdir[k][0];
+        bb[k] += mid * bdir[k][1];
+      }
+      else
+      {
+        ba[k] -= mid * bdir[k][1];
+        bb[k] += mid * bdir[k][0];
+      }
+    }
+    if (fn[k][4] >= 3)
+      bht[k] = fs[k][4] / fn[k][4];
+  }
+}
+
+
+//= Find rms distance of object points from fitted box and cylinder.
+
+void jhcTofShape::residuals (const jhcTofObjs& objs, const jhcTofCloud& cloud)
+{
+  int n[100];
+  const unsigned short *lab = objs.Labels();
+  const short *hgt = objs.Height();
+  const float *p = cloud.Cam();
+  float a, b, s1, s2, e;
+  int i, k;
+
+  // clear accumulators
+  for (k = 0; k < nobj; k++)
+  {
+    berr[k] = 0.0f;
+    cerr[k] = 0.0f;
+    n[k] = 0;
+  }
+
+  // sum squared distances
+  for (i = 0; i < 10000; i++, p += 3)
+  {
+    if ((k = lab[i] - 1) < 0)
+      continue;
+    a = ux[0] * p[0] + ux[1] * p[1] + ux[2] * p[2];
+    b = vx[0] * p[0] + vx[1] * p[1] + vx[2] * p[2];
+    box_local(s1, s2, k, a, b);
+    e = box_dist(s1, s2, hgt[i], k);
+    berr[k] += e * e;
+    e = cyl_dist(a, b, hgt[i], k);
+    cerr[k] += e * e;
+    n[k]++;
+  }
+
+  // convert to rms
+  for (k = 0; k < nobj; k++)
+    if (n[k] > 0)
+    {
+      berr[k] = sqrtf(berr[k] / n[k]);
+      cerr[k] = sqrtf(cerr[k] / n[k]);
+    }
+}
+
+
+//= Pick best primitive for object "k" and express it in camera frame.
+// box axis is its long direction, cylinder axis is plane normal
+// dims are length, width, and height (diameter twice for cylinder)
+
+void jhcTofShape::results (int k)
+{
+  float a, b, h = -d0;
+  int i;
+
+  if (berr[k] <= bias * cerr[k])
+  {
+    kind[k] = 1;
+    a = ba[k];
+    b = bb[k];
+    for (i = 0; i < 3; i++)
+      ax[k][i] = bdir[k][0] * ux[i] + bdir[k][1] * vx[i];
+    dims[k][0] = 2.0f * bhalf[k][0];
+    dims[k][1] = 2.0f * bhalf[k][1];
+  }
+  else
+  {
+    kind[k] = 2;
+    a = ca[k];
+    b = cb[k];
+    for (i = 0; i < 3; i++)
+      ax[k][i] = nx[i];
+    dims[k][0] = 2.0f * crad[k];
+    dims[k][1] = dims[k][0];
+  }
+  dims[k][2] = bht[k];
+  for (i = 0; i < 3; i++)
+    ctr[k][i] = a * ux[i] + b * vx[i] + h * nx[i];
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                           Shape Geometry                              //
+///////////////////////////////////////////////////////////////////////////
+
+//= Convert plane coordinates to offsets along box axes from box center.
+
+void jhcTofShape::box_local (float& s1, float& s2, int k, float a, float b) const
+{
+  float da = a - ba[k], db = b - bb[k];
+
+  s1 = da * bdir[k][0] + db * bdir[k][1];
+  s2 = db * bdir[k][0] - da * bdir[k][1];
+}
+
+
+//= Distance of point at box offsets and height "h" from surface of box "k".
+
+float jhcTofShape::box_dist (float s1, float s2, float h, int k) const
+{
+  float d1 = fabsf(s1) - bhalf[k][0], d2 = fabsf(s2) - bhalf[k][1], dh = h - bht[k];
+  float in;
+
+  // inside means distance to nearest face
+  if ((d1 <= 0.0f) && (d2 <= 0.0f) && (dh <= 0.0f))
+  {
+    in = ((d1 > d2) ? d1 : d2);
+    return -((dh > in) ? dh : in);
+  }
+
+  // outside means distance to nearest corner, edge, or face
+  d1 = ((d1 > 0.0f) ? d1 : 0.0f);
+  d2 = ((d2 > 0.0f) ? d2 : 0.0f);
+  dh = ((dh > 0.0f) ? dh : 0.0f);
+  return sqrtf(d1 * d1 + d2 * d2 + dh * dh);
+}
+
+
+//= Distance of point in plane coordinates at height "h" from cylinder "k".
+
+float jhcTofShape::cyl_dist (float a, float b, float h, int k) const
+{
+  float da = a - ca[k], db = b - cb[k];
+  float dr = sqrtf(da * da + db * db) - crad[k], dh = h - bht[k];
+
+  // inside means distance to wall or top
+  if ((dr <= 0.0f) && (dh <= 0.0f))
+    return -((dr > dh) ? dr : dh);
+
+  // outside means distance to rim, wall, or top
+  dr = ((dr > 0.0f) ? dr : 0.0f);
+  dh = ((dh > 0.0f) ? dh : 0.0f);
+  return sqrtf(dr * dr + dh * dh);
+}
@@ -0,0 +1,223 @@
+// jhcTofTee.cpp : records exact received serial byte stream to a file
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE                  // for O_DIRECT
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <jhcTofTee.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Destructor cleans up files and any allocated items.
+
+jhcTofTee::~jhcTofTee ()
+{
+  Close();
+}
+
+
+//= Default constructor initializes certain values.
+
+jhcTofTee::jhcTofTee ()
+{
+  file = -1;
+  run = 0;
+  ring = NULL;
+  head = 0;
+  tail = 0;
+  rsz = 0;
+  blk = 0;
+  drop = 0;
+  cost = 0;
+  calls = 0;
+  over = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+//= Start recording to file with "mb" ring buffer and "kb" write blocks.
+// ring should hold several seconds of data (sensor is about 150KB/s)
+// returns 1 if okay, 0 for problem
+
+int jhcTofTee::Open (const char *fname, int mb, int kb)
+{
+  void *mem;
+
+  // make aligned ring buffer (size is a multiple of block size)
+  Close();
+  if ((fname == NULL) || (*fname == '\0'))
+    return 0;
+  blk = kb << 10;
+  rsz = (mb << 20) / blk * blk;
+  rsz = ((rsz > blk) ? rsz : 2 * blk);
+  if (posix_memalign(&mem, 4096, rsz) != 0)
+    return 0;
+  ring = (unsigned char *) mem;
+  memset(ring, 0, rsz);                // pre-fault pages
+
+  // try opening file for unbuffered writes
+  file = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+  if (file < 0)
+    file = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (file < 0)
+  {
+    Close();
+    return 0;
+  }
+
+  // reset statistics and start writer
+  head = 0;
+  tail = 0;
+  drop = 0;
+  cost = 0;
+  calls = 0;
+  over = 0;
+  run = 1;
+  pthread_create(&scribe, NULL, drain, (void *) this);
+  return 1;
+}
+
+
+//= Copy "n" received bytes into ring buffer (called by acquisition thread).
+// stops recording for good if not enough room (writer is too slow)
+// since a gap inside a packet would desynchronize later playback
+
+void jhcTofTee::Add (const unsigned char *src, int n)
+{
+  timespec t0, t1;
+  long long h, t;
+  int i, n1;
+
+  // see if recording and ring has room
+  if ((file < 0) || (n <= 0))
+    return;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  h = head;
+  t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+  if ((over > 0) || (h + n - t > rsz))
+  {
+    if (over <= 0)
+      printf(">>> jhcTofTee: ring overflow, recording truncated!\n");
+    over = 1;
+    drop += n;
+  }
+  else
+  {
+    // copy in one or two pieces (if wraps around)
+    i = (int)(h % rsz);
+    n1 = rsz - i;
+    n1 = ((n < n1) ? n : n1);
+    memcpy(ring + i, src, n1);
+    if (n1 < n)
+      memcpy(ring, src + n1, n - n1);
+    __atomic_store_n(&head, h + n, __ATOMIC_RELEASE);
+  }
+
+  // record time taken
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  cost += (t1.tv_sec - t0.tv_sec) * 1000000000LL + (t1.tv_nsec - t0.tv_nsec);
+  calls++;
+}
+
+
+//= Stop recording and write out any remaining bytes.
+
+void jhcTofTee::Close ()
+{
+  // stop writer thread (flushes full blocks)
+  if (run > 0)
+  {
+    run = 0;
+    pthread_join(scribe, NULL);
+  }
+
+  // write partial last block without O_DIRECT
+  if (file >= 0)
+  {
+    fcntl(file, F_SETFL, fcntl(file, F_GETFL) & ~O_DIRECT);
+    flush(1);
+    close(file);
+    file = -1;
+  }
+  free(ring);
+  ring = NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                            Writer Thread                              //
+///////////////////////////////////////////////////////////////////////////
+
+//= Background thread writes full blocks as they become available.
+
+void *jhcTofTee::drain (void *tee)
+{
+  jhcTofTee *me = (jhcTofTee *) tee;
+
+  while (me->run > 0)
+    if (me->flush(0) <= 0)
+      usleep(10000);                   // wait for more data
+  me->flush(0);
+  return NULL;
+}
+
+
+//= Write all complete blocks in ring to file (and partial block if "all").
+// blocks never straddle end of ring since its size is a multiple
+// returns number of blocks written
+
+int jhcTofTee::flush (int all)
+{
+  long long h, t = tail;
+  int n, cnt = 0;
+
+  h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  while ((h - t) >= blk)
+  {
+    if (write(file, ring + (t % rsz), blk) != blk)
+      break;
+    t += blk;
+    __atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+    cnt++;
+  }
+  if ((all > 0) && ((n = (int)(h - t)) > 0))
+  {
+    n = ((n < blk) ? n : blk);
+    if (write(file, ring + (t % rsz), n) == n)
+      __atomic_store_n(&tail, t + n, __ATOMIC_RELEASE);
+  }
+  return cnt;
+}
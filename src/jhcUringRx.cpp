@@ -0,0 +1,319 @@
+// jhcUringRx.cpp : serial byte receiver using Linux io_uring with fixed buffers
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+///////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+  #define JHC_URING
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #include <sys/uio.h>
+  #include <linux/io_uring.h>
+#endif
+#endif
+
+#include <jhcUringRx.h>
+
+
+///////////////////////////////////////////////////////////////////////////
+//                      Creation and Initialization                      //
+///////////////////////////////////////////////////////////////////////////
+
+//= Destructor cleans up files and any allocated items.
+
+jhcUringRx::~jhcUringRx ()
+{
+  Close();
+}
+
+
+//= Default constructor initializes certain values.
+
+jhcUringRx::jhcUringRx ()
+{
+  ring = -1;
+  poll = 0;
+  sq_map = NULL;
+  cq_map = NULL;
+  sqe_map = NULL;
+  pool = NULL;
+  nb = 0;
+  bsz = 0;
+  post = -1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+//                              Main Functions                           //
+///////////////////////////////////////////////////////////////////////////
+
+#ifdef JHC_URING
+
+//= Set up ring for reading from serial port "fd" into "nbuf" fixed buffers.
+// if "spin" > 0 then tries kernel submission thread (burns some cpu)
+// posts first read immediately, must call Close before closing "fd"
+// returns 1 if okay, 0 if io_uring not available (use read instead)
+
+int jhcUringRx::Open (int fd, int nbuf, int sz, int spin)
+{
+  struct io_uring_params p;
+  struct iovec iov[16];
+  void *mem;
+  int i;
+
+  // get aligned pool of buffers
+  Close();
+  nb = ((nbuf <= 2) ? 2 : ((nbuf < 16) ? nbuf : 16));
+  bsz = sz;
+  if (posix_memalign(&mem, 4096, nb * bsz) != 0)
+    return 0;
+  pool = (unsigned char *) mem;
+
+  // create ring (possibly with kernel polling thread)
+  if (spin > 0)
+  {
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SQPOLL;
+    p.sq_thread_idle = 100;            // ms before sleeping
+    ring = (int) syscall(__NR_io_uring_setup, 4, &p);
+    poll = 1;
+  }
+  if (ring < 0)
+  {
+    memset(&p, 0, sizeof(p));
+    ring = (int) syscall(__NR_io_uring_setup, 4, &p);
+    poll = 0;
+  }
+  if ((ring < 0) || (map_rings(&p) <= 0))
+  {
+    Close();
+    return 0;
+  }
+
+  // register buffer pool and serial port with kernel
+  for (i = 0; i < nb; i++)
+  {
+    iov[i].iov_base = pool + i * bsz;
+    iov[i].iov_len = bsz;
+  }
+  if ((syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, iov, nb) < 0) ||
+      (syscall(__NR_io_uring_register, ring, IORING_REGISTER_FILES, &fd, 1) < 0))
+  {
+    Close();
+    return 0;
+  }
+
+  // start first read
+  if (post_read(0) <= 0)
+  {
+    Close();
+    return 0;
+  }
+  return 1;
+}
+
+
+//= Map shared submission and completion rings into user space.
+// returns 1 if okay, 0 for problem
+
+int jhcUringRx::map_rings (void *params)
+{
+  struct io_uring_params *p = (struct io_uring_params *) params;
+  unsigned char *sq, *cq;
+
+  // figure out sizes of regions
+  sq_sz = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+  cq_sz = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+  sqe_sz = p->sq_entries * sizeof(struct io_uring_sqe);
+  if ((p->features & IORING_FEAT_SINGLE_MMAP) != 0)
+    sq_sz = ((cq_sz > sq_sz) ? cq_sz : sq_sz);
+
+  // map submission ring and possibly separate completion ring
+  sq_map = mmap(NULL, sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ring, IORING_OFF_SQ_RING);
+  if (sq_map == MAP_FAILED)
+  {
+    sq_map = NULL;
+    return 0;
+  }
+  cq_map = sq_map;
+  if ((p->features & IORING_FEAT_SINGLE_MMAP) == 0)
+  {
+    cq_map = mmap(NULL, cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring, IORING_OFF_CQ_RING);
+    if (cq_map == MAP_FAILED)
+    {
+      cq_map = NULL;
+      return 0;
+    }
+  }
+
+  // map array of submission entries
+  sqe_map = mmap(NULL, sqe_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 ring, IORING_OFF_SQES);
+  if (sqe_map == MAP_FAILED)
+  {
+    sqe_map = NULL;
+    return 0;
+  }
+
+  // get pointers to ring indices
+  sq = (unsigned char *) sq_map;
+  sq_head  = (unsigned *)(sq + p->sq_off.head);
+  sq_tail  = (unsigned *)(sq + p->sq_off.tail);
+  sq_mask  = (unsigned *)(sq + p->sq_off.ring_mask);
+  sq_flags = (unsigned *)(sq + p->sq_off.flags);
+  sq_array = (unsigned *)(sq + p->sq_off.array);
+  cq = (unsigned char *) cq_map;
+  cq_head = (unsigned *)(cq + p->cq_off.head);
+  cq_tail = (unsigned *)(cq + p->cq_off.tail);
+  cq_mask = (unsigned *)(cq + p->cq_off.ring_mask);
+  cqes = cq + p->cq_off.cqes;
+  return 1;
+}
+
+
+//= Queue a read of serial port into fixed buffer "b" and submit it.
+// if kernel thread is polling then usually no syscall is needed
+// returns 1 if okay, 0 for problem
+
+int jhcUringRx::post_read (int b)
+{
+  struct io_uring_sqe *sqe;
+  unsigned tail, idx;
+
+  // fill in next free submission entry
+  tail = *sq_tail;
+  idx = tail & *sq_mask;
+  sqe = (struct io_uring_sqe *) sqe_map + idx;
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode = IORING_OP_READ_FIXED;
+  sqe->flags = IOSQE_FIXED_FILE;
+  sqe->fd = 0;                         // first registered file
+  sqe->addr = (unsigned long long)(pool + b * bsz);
+  sqe->len = bsz;
+  sqe->off = (__u64) -1;               // current position (serial ignores)
+  sqe->buf_index = (unsigned short) b;
+  sqe->user_data = b;
+
+  // publish entry to kernel
+  sq_array[idx] = idx;
+  __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  post = b;
+
+  // tell kernel about it (or wake up polling thread)
+  if (poll > 0)
+  {
+    if ((__atomic_load_n(sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP) != 0)
+      syscall(__NR_io_uring_enter, ring, 0, 0, IORING_ENTER_SQ_WAKEUP, NULL, 0);
+    return 1;
+  }
+  if (syscall(__NR_io_uring_enter, ring, 1, 0, 0, NULL, 0) < 0)
+    return 0;
+  return 1;
+}
+
+
+//= Wait for the pending read to finish and immediately post the next one.
+// sets "chunk" to received bytes, valid until following call
+// returns byte count, 0 if serial timeout, negative for error
+
+int jhcUringRx::Next (unsigned char **chunk)
+{
+  struct io_uring_cqe *cqe;
+  unsigned head;
+  int b, rc;
+
+  // check that a read is outstanding
+  if ((ring < 0) || (post < 0))
+    return -1;
+
+  // reap completion from ring (only syscall if not finished yet)
+  while (1)
+  {
+    head = *cq_head;
+    if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+      break;
+    if (syscall(__NR_io_uring_enter, ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+      if (errno != EINTR)
+        return -1;
+  }
+  cqe = (struct io_uring_cqe *) cqes + (head & *cq_mask);
+  rc = cqe->res;
+  b = (int) cqe->user_data;
+  __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+
+  // keep next buffer filling while caller digests this one
+  post = -1;
+  if (post_read((b + 1) % nb) <= 0)
+    return -1;
+  *chunk = pool + b * bsz;
+  return rc;
+}
+
+#else
+
+//= Stub when io_uring is not supported by this system.
+
+int jhcUringRx::Open (int fd, int nbuf, int sz, int spin)
+{
+  return 0;
+}
+
+
+//= Stub when io_uring is not supported by this system.
+
+int jhcUringRx::Next (unsigned char **chunk)
+{
+  return -1;
+}
+
+#endif
+
+
+//= Tear down ring (cancelling any pending read) and release buffer pool.
+
+void jhcUringRx::Close ()
+{
+#ifdef JHC_URING
+  if (sqe_map != NULL)
+    munmap(sqe_map, sqe_sz);
+  if ((cq_map != NULL) && (cq_map != sq_map))
+    munmap(cq_map, cq_sz);
+  if (sq_map != NULL)
+    munmap(sq_map, sq_sz);
+#endif
+  sqe_map = NULL;
+  cq_map = NULL;
+  sq_map = NULL;
+  if (ring >= 0)
+    close(ring);
+  ring = -1;
+  poll = 0;
+  post = -1;
+  free(pool);
+  pool = NULL;
+}
@@ -0,0 +1,146 @@
+// tof_calib.cpp : finds relative poses of several sensors from shared planes
+//
+// Written by Jonathan H. Connell, jconnell@alum.mit.edu
+//
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2024 Etaoin Systems
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// 
+///////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <jhcTofCam.h>
+#include <jhcTofCalib.h>
+
+
+//= Whether string is all digits (a serial port number).
+
+int all_digits (const char *txt)
+{
+  const char *c = txt;
+
+  if (*c == '\0')
+    return 0;
+  for (; *c != '\0'; c++)
+    if (isdigit(*c) == 0)
+      return 0;
+  return 1;
+}
+
+
+//= Shut down all sensors that were opened.
+
+void stop_all (jhcTofCam *tof, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    tof[i].Done();
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+
+//= Collect frames from several sensors viewing the same planes then solve.
+// each source is a serial port number (live) or a recorded file (replay)
+// rough poses come from guess file, results written to output file
+
+int main (int argc, char *argv[])
+{
+  const char *usage = "usage: tof_calib [-n frames] [-k skip] [-g guess.cfg] [-o out.cfg] src0 src1 ...\n";
+  const char *gfile = NULL, *ofile = "tof_calib.cfg";
+  static jhcTofCam tof[8];
+  jhcTofCalib cal;
+  jhcTofCloud rough;
+  const unsigned char *range[8];
+  float p[6];
+  int i, s, f, n = 20, skip = 10, ns = 0, ok = 1, good;
+
+  // parse options then sources
+  for (i = 1; i < argc; i++)
+    if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc))
+    {
+      if (sscanf(argv[++i], "%d", &n) != 1)
+        return printf(usage);
+    }
+    else if ((strcmp(argv[i], "-k") == 0) && (i + 1 < argc))
+    {
+      if (sscanf(argv[++i], "%d", &skip) != 1)
+        return printf(usage);
+    }
+    else if ((strcmp(argv[i], "-g") == 0) && (i + 1 < argc))
+      gfile = argv[++i];
+    else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc))
+      ofile = argv[++i];
+    else if (argv[i][0] == '-')
+      return printf(usage);
+    else if (ns >= 8)
+      return printf("At most 8 sensors allowed!\n");
+    else
+    {
+      // try to start up sensor or playback
+      if (all_digits(argv[i]) > 0)
+        s = tof[ns].Start(atoi(argv[i]));
+      else
+        s = tof[ns].Replay(argv[i]);
+      if (s <= 0)
+      {
+        printf("Could not open source %s!\n", argv[i]);
+        stop_all(tof, ns);
+        return -1;
+      }
+      ns++;
+    }
+  if (ns < 2)
+    return printf(usage);
+
+  // set up rough poses
+  cal.Reset(ns);
+  if (gfile != NULL)
+    for (s = 0; s < ns; s++)
+      if (jhcTofCalib::Load(rough, gfile, s) > 0)
+        cal.SetGuess(s, rough);
+
+  // gather frame sets spread out in time
+  printf("Collecting %d frame sets from %d sensors ...\n", n, ns);
+  for (f = 0; (f < n) && (ok > 0); f++)
+  {
+    for (i = 0; (i <= skip) && (ok > 0); i++)
+      for (s = 0; (s < ns) && (ok > 0); s++)
+        if ((range[s] = tof[s].Range(1)) == NULL)
+          ok = 0;
+    if (ok > 0)
+      printf("  [%d] %d planes found\n", f, cal.AddFrame(range));
+  }
+  stop_all(tof, ns);
+
+  // find and report relative poses
+  if ((good = cal.Solve()) < ns)
+    printf("Only %d of %d sensors have enough shared planes!\n", good, ns);
+  for (s = 0; s < ns; s++)
+  {
+    cal.Pose(p, s);
+    printf("sensor %d: %6.1f %6.1f %6.1f mm, %6.2f %6.2f %6.2f deg (%d planes, %4.2f deg, %3.1f mm)\n",
+           s, p[0], p[1], p[2], p[3], p[4], p[5], cal.Matches(s), cal.AngErr(s), cal.OffErr(s));
+  }
+  if (cal.Save(ofile) <= 0)
+    return printf("Could not write %s!\n", ofile);
+  printf("Poses saved in %s\n", ofile);
+  return 0;
+}
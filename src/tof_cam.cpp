@@ -21,6 +21,20 @@
 ///////////////////////////////////////////////////////////////////////////
 
 #include <jhcTofCam.h>
+#include <jhcTofFlow.h>
+#include <jhcTofObjs.h>
+#include <jhcTofGrasp.h>
+#include <jhcTofShape.h>
+#include <jhcTofMesh.h>
+#include <jhcTofPlanes.h>
+#include <jhcTofNav.h>
+#include <jhcTofGrid.h>
+#include <jhcTofLevel.h>
+#include <jhcTofCollide.h>
+#include <jhcTofHash.h>
+#include <jhcTofIcp.h>
+#include <jhcTofRgb.h>
+#include <jhcTofCalib.h>
 
 
 ///////////////////////////////////////////////////////////////////////////
@@ -32,12 +46,94 @@
 static jhcTofCam tof;
 
 
+//= Organized point cloud and pyramid built from last Range() image.
+
+static jhcTofCloud cloud;
+
+
+//= Dense 3D motion between successive tof_flow() calls.
+
+static jhcTofFlow flow;
+
+
+//= Objects sitting on support plane in last Range() image.
+
+static jhcTofObjs objs;
+
+
+//= Top-down grasps for objects found in last Range() image.
+
+static jhcTofGrasp grasp;
+
+
+//= Box and cylinder fits for objects found in last Range() image.
+
+static jhcTofShape shape;
+
+
+//= Pose trackers for known object templates.
+
+static jhcTofIcp icp;
+
+
+//= Triangulated surface from last Range() image.
+
+static jhcTofMesh mesh;
+
+
+//= Depth image re-projected into an external RGB camera.
+
+static jhcTofRgb rgb;
+
+
+//= All large planar surfaces in last Range() image.
+
+static jhcTofPlanes planes;
+
+
+//= Free floor distance in each direction for last Range() image.
+
+static jhcTofNav nav;
+
+
+//= Overhead height map and obstacle distances for last Range() image.
+
+static jhcTofGrid grid;
+
+
+//= Pinned depth image for sphere and capsule collision queries.
+
+static jhcTofCollide coll;
+
+
+//= Spatial hash of points for neighborhood queries on last Range() image.
+
+static jhcTofHash hash;
+
+
+//= Floor tracker for keeping camera tilt, roll, and height current.
+
+static jhcTofLevel level;
+static int autolev = 0;
+
+
+//= Capture time of image last converted into point cloud.
+
+static long long cvt = 0;
+
+
+//= Local helper functions.
+
+static int update_cloud ();
+
+
 ///////////////////////////////////////////////////////////////////////////
 //                           Main Functions                              //
 ///////////////////////////////////////////////////////////////////////////
 
 //= Open connection to sensor and start background acquisition thread.
-// "port" is lower COMx number in Windows Device Manager (Linux ignores)
+// "port" is lower COMx number in Windows Device Manager, on Linux it
+// selects /dev/ttyUSB<port> if that exists else falls back to /dev/ttyUSB0
 // returns 1 if okay, 0 or negative for error
 
 extern "C" int tof_start (int port)
@@ -46,15 +142,63 @@ extern "C" int tof_start (int port)
 }
 
 
-//= Get a pointer to the most recent 16 bit depth image from sensor.
+//= Get a pointer to the most recent 16 bit depth image.
 // buffer is always 100 x 100 with 16 bit pixels and 0.25mm resolution 
 // with USB on left: scans right-to-left, top-down from upper right corner
 // typically 14.8 fps, image guaranteed unchanged until next Range() call
+// analysis functions below all use images from default subscriber 0
 // returns pixel buffer pointer, NULL if not ready or stream broken
 
 extern "C" const unsigned char *tof_range (int block)
 {
-  return tof.Range(block);
+  return tof.Range(block, 0);
+}
+
+
+//= Get a pointer to the most recent 16 bit depth image for subscriber "sub".
+// same as tof_range but for images delivered at subscriber's own rate
+
+extern "C" const unsigned char *tof_range_sub (int block, int sub)
+{
+  return tof.Range(block, sub);
+}
+
+
+//= Add or change a subscriber wanting images at "fps" (0 = every frame).
+// "outs" is a bit mask of optional outputs: 1 = time-to-contact, 2 = events
+// uses slot "sub" if non-negative (0 is default) else picks a free one
+// returns subscriber number, negative if none available
+
+extern "C" int tof_subscribe (float fps, int outs, int sub)
+{
+  return tof.Subscribe(fps, outs, sub);
+}
+
+
+//= Stop delivering images to subscriber "sub".
+
+extern "C" void tof_unsubscribe (int sub)
+{
+  tof.Unsubscribe(sub);
+}
+
+
+//= Play back byte stream saved by tof_record instead of live sensor.
+// returns 1 if okay, 0 or negative for error
+
+extern "C" int tof_replay (const char *fname)
+{
+  return tof.Replay(fname);
+}
+
+
+//= Save exact received serial byte stream to file (call before tof_start).
+// recording stops with tof_done, cannot be changed while streaming
+// returns 1 if file opened, 0 if not, negative if streaming
+
+extern "C" int tof_record (const char *fname)
+{
+  return tof.Record(fname);
 }
 
 
@@ -66,6 +210,821 @@ extern "C" void tof_done ()
 }
 
 
+//= Estimated capture time (ns since boot) of image from last Range() call.
+// de-jittered using frame ids in sensor headers
+
+extern "C" long long tof_stamp ()
+{
+  return tof.Stamp(0);
+}
+
+
+//= Estimated capture time (ns since boot) of image from last tof_range_sub.
+
+extern "C" long long tof_stamp_sub (int sub)
+{
+  return tof.Stamp(sub);
+}
+
+
+//= Uncertainty (ms) in estimated capture time from last Range() call.
+
+extern "C" float tof_stamp_err ()
+{
+  return tof.StampErr();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                             Frame Quality                               //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Fraction of pixels with valid depth in image from last Range() call.
+
+extern "C" float tof_valid ()
+{
+  const jhcTofMeta *info = tof.Info();
+
+  return((info != NULL) ? info->valid : 0.0f);
+}
+
+
+//= Fraction of sensor pixels saturated in image from last Range() call.
+
+extern "C" float tof_saturated ()
+{
+  const jhcTofMeta *info = tof.Info();
+
+  return((info != NULL) ? info->satd : 0.0f);
+}
+
+
+//= Mean temporal variance (mm^2) of valid pixels from last Range() call.
+
+extern "C" float tof_noise ()
+{
+  const jhcTofMeta *info = tof.Info();
+
+  return((info != NULL) ? info->mvar : 0.0f);
+}
+
+
+//= Fraction of pixels blanked due to motion in last Range() call image.
+
+extern "C" float tof_motion ()
+{
+  const jhcTofMeta *info = tof.Info();
+
+  return((info != NULL) ? info->motion : 0.0f);
+}
+
+
+//= Whether range step changed just before image from last Range() call.
+
+extern "C" int tof_jump ()
+{
+  const jhcTofMeta *info = tof.Info();
+
+  return((info != NULL) ? info->jump : 0);
+}
+
+
+//= Histogram of 8 bit sensor values for image from last Range() call.
+// "roi" selects whole frame (0) or auto-range ROI (1), bin 255 is saturated
+// "step" is set to depth (mm) of each bin, returns 256 counts (NULL if none)
+
+extern "C" const int *tof_histogram (int *step, int roi)
+{
+  const jhcTofMeta *info = tof.Info();
+
+  *step = ((info != NULL) ? info->step : 0);
+  if (info == NULL)
+    return NULL;
+  return((roi > 0) ? info->rhist : info->hist);
+}
+
+
+//= Get 10th, 50th, and 90th percentile depths (mm) from last Range() call.
+// "roi" selects whole frame (0) or auto-range ROI (1), ignores saturated
+// returns 1 if okay, 0 if no image or no valid pixels
+
+extern "C" int tof_depth_pcts (float *pcts, int roi)
+{
+  const jhcTofMeta *info = tof.Info();
+  const float *p;
+  int i;
+
+  if (info == NULL)
+    return 0;
+  p = ((roi > 0) ? info->rpct : info->dpct);
+  for (i = 0; i < 3; i++)
+    pcts[i] = p[i];
+  return((p[1] >= 0.0f) ? 1 : 0);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                            Time to Contact                              //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Shortest time-to-contact (sec) in ROI for image from last Range() call.
+// negative if nothing in ROI is approaching
+
+extern "C" float tof_ttc ()
+{
+  const jhcTofMeta *info = tof.Info();
+
+  return((info != NULL) ? info->ttc : -1.0f);
+}
+
+
+//= Pixel coordinates of shortest time-to-contact from last Range() call.
+// both are negative if nothing is approaching
+
+extern "C" void tof_ttc_pos (int *x, int *y)
+{
+  const jhcTofMeta *info = tof.Info();
+
+  *x = ((info != NULL) ? info->tx : -1);
+  *y = ((info != NULL) ? info->ty : -1);
+}
+
+
+//= Get time-to-contact map (ms) for image from last Range() call.
+// buffer is 100 x 100 with 16 bit pixels, 65535 = not approaching
+// returns pixel buffer pointer, NULL if not ready or not computed
+
+extern "C" const unsigned char *tof_contact ()
+{
+  return tof.Contact(0);
+}
+
+
+//= Get time-to-contact map (ms) for image from last tof_range_sub call.
+
+extern "C" const unsigned char *tof_contact_sub (int sub)
+{
+  return tof.Contact(sub);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                             Change Events                               //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Set change event cell size (1 or 4 pixels), min change (mm), and refresh.
+// full list of cells is sent every "key" frames (0 = only at start)
+
+extern "C" void tof_events_cfg (int blk, float tol, int key)
+{
+  tof.eblk = blk;
+  tof.etol = tol;
+  tof.ekey = key;
+}
+
+
+//= Get list of cells whose depth changed for image from last Range() call.
+// header is grid width and full refresh flag, then runs of start, count,
+// and that many 16 bit depths, "n" is set to number of 16 bit words
+// returns list pointer, NULL if not ready or not requested
+
+extern "C" const unsigned short *tof_events (int *n)
+{
+  return tof.Events(*n, 0);
+}
+
+
+//= Get list of changed cells for image from last tof_range_sub call.
+
+extern "C" const unsigned short *tof_events_sub (int *n, int sub)
+{
+  return tof.Events(*n, sub);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                          Precise Static Capture                         //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Collect "n" frames at fixed range step and robustly average each pixel.
+// drops "trim" percent of samples at each end (50 gives median)
+// returns 1 if done, 0 if still running or timeout, negative for error
+
+extern "C" int tof_precise (int n, int trim, int block)
+{
+  return tof.Precise(n, trim, block);
+}
+
+
+//= Get 16 bit depth image (0.25mm units) from last precise capture.
+// returns pixel buffer pointer, NULL if capture not finished
+
+extern "C" const unsigned char *tof_precise_depth ()
+{
+  return tof.PreciseDepth();
+}
+
+
+//= Get 16 bit standard deviation image (0.25mm) from last precise capture.
+// returns pixel buffer pointer, NULL if capture not finished
+
+extern "C" const unsigned char *tof_precise_dev ()
+{
+  return tof.PreciseDev();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                              Camera Pose                                //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Set position (mm) and orientation (degrees) of camera relative to floor.
+// world frame has X to right, Y forward, and Z up from floor
+
+extern "C" void tof_pose (float x, float y, float z, float pan, float tilt, float roll)
+{
+  cloud.cx = x;
+  cloud.cy = y;
+  cloud.cz = z;
+  cloud.pan = pan;
+  cloud.tilt = tilt;
+  cloud.roll = roll;
+  cvt = 0;
+}
+
+
+//= Set camera pose from entry for "sensor" in file written by tof_calib.
+// returns 1 if okay, 0 if sensor or file not found
+
+extern "C" int tof_calib_load (const char *fname, int sensor)
+{
+  if (jhcTofCalib::Load(cloud, fname, sensor) <= 0)
+    return 0;
+  cvt = 0;
+  return 1;
+}
+
+
+//= Automatically adjust camera tilt, roll, and height from floor (on = 1).
+// tracking starts from height and angles given by tof_pose() (if height > 0)
+// otherwise or when lost it restarts from dominant plane in image
+
+extern "C" void tof_autolevel (int on)
+{
+  autolev = on;
+  level.Reset();
+}
+
+
+//= Get camera tilt and roll (degrees) and height (mm) found by auto-leveling.
+// returns 1 if big change in last image, 0 if steady, -1 if not tracking
+
+extern "C" int tof_level (float *tilt, float *roll, float *ht)
+{
+  *tilt = level.Tilt();
+  *roll = level.Roll();
+  *ht = level.Height();
+  if (level.Tracking() <= 0)
+    return -1;
+  return level.Changed();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                              Scene Flow                                 //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Find 3D motion of each pixel since image used in previous call.
+// uses image from last Range() call (call once per frame)
+// returns number of pixels with valid flow, 0 on first call
+
+extern "C" int tof_flow ()
+{
+  if (update_cloud() <= 0)
+    return 0;
+  return flow.Analyze(cloud);
+}
+
+
+//= Get flow vectors from last tof_flow() call.
+// 100 x 100 pixels of 3 signed 16 bit values (camera x, y, z in mm)
+// vector for pixel is motion of point seen there in previous image
+
+extern "C" const short *tof_flow_img ()
+{
+  return flow.Flow();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                            Object Measurement                           //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Find support plane and objects on it in image from last Range() call.
+// returns number of objects found (0 if no plane)
+
+extern "C" int tof_objects ()
+{
+  if (update_cloud() <= 0)
+    return 0;
+  return objs.Analyze(cloud);
+}
+
+
+//= Get size of object "i" (1 to count) from last tof_objects() call.
+// volume in mm^3, footprint on plane in mm^2, max height in mm
+// returns number of pixels in object (0 if bad index)
+
+extern "C" int tof_object (int i, float *vol, float *area, float *ht)
+{
+  *vol = objs.Volume(i);
+  *area = objs.Footprint(i);
+  *ht = objs.MaxHt(i);
+  return objs.Pixels(i);
+}
+
+
+//= Get object label image from last tof_objects() call.
+// 100 x 100 pixels of 16 bit object numbers (0 = background)
+
+extern "C" const unsigned short *tof_obj_labels ()
+{
+  return objs.Labels();
+}
+
+
+//= Find objects in image from last Range() call and propose grasps for them.
+// same objects as tof_objects() so labels and sizes also become available
+// returns number of grasps found
+
+extern "C" int tof_grasps ()
+{
+  if (tof_objects() <= 0)
+    return 0;
+  return grasp.Analyze(objs, cloud);
+}
+
+
+//= Get grasp "i" (1 to count) from last tof_grasps() call in camera frame.
+// "pos" and "dir" receive 3 values each (grasp point mm, jaw closing direction)
+// "wid" is object size between jaws, "clr" is free space outside jaws (mm)
+// returns object number for grasp (0 if bad index)
+
+extern "C" int tof_grasp (int i, float *pos, float *dir, float *wid, float *clr)
+{
+  const float *p = grasp.Point(i), *d = grasp.Closing(i);
+  int j;
+
+  if ((p == NULL) || (d == NULL))
+    return 0;
+  for (j = 0; j < 3; j++)
+  {
+    pos[j] = p[j];
+    dir[j] = d[j];
+  }
+  *wid = grasp.Width(i);
+  *clr = grasp.Clearance(i);
+  return grasp.Object(i);
+}
+
+
+//= Get gripper approach direction for last tof_grasps() call in camera frame.
+// "dir" receives 3 values of unit vector pointing into support plane
+
+extern "C" void tof_grasp_approach (float *dir)
+{
+  const float *a = grasp.Approach();
+
+  dir[0] = a[0];
+  dir[1] = a[1];
+  dir[2] = a[2];
+}
+
+
+//= Find objects in image from last Range() call and fit primitives to them.
+// same objects as tof_objects() so labels and sizes also become available
+// returns number of objects fit
+
+extern "C" int tof_shapes ()
+{
+  if (tof_objects() <= 0)
+    return 0;
+  return shape.Analyze(objs, cloud);
+}
+
+
+//= Get best primitive for object "i" (1 to count) from last tof_shapes() call.
+// "ctr" is base center on plane, "axis" is box long direction or cylinder up
+// "dims" is length, width, and height (diameter twice for cylinder)
+// "err" receives rms residual for box then cylinder (all in mm, camera frame)
+// returns 1 for box, 2 for cylinder (0 if bad index)
+
+extern "C" int tof_shape (int i, float *ctr, float *axis, float *dims, float *err)
+{
+  const float *c = shape.Center(i), *a = shape.Axis(i), *d = shape.Dims(i);
+  int j;
+
+  if ((c == NULL) || (a == NULL) || (d == NULL))
+    return 0;
+  for (j = 0; j < 3; j++)
+  {
+    ctr[j] = c[j];
+    axis[j] = a[j];
+    dims[j] = d[j];
+  }
+  err[0] = shape.BoxErr(i);
+  err[1] = shape.CylErr(i);
+  return shape.Kind(i);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                            Object Tracking                              //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Load template "i" (0-7) with "n" points and optional normals (NULL if none).
+// returns number of points kept, 0 if bad slot
+
+extern "C" int tof_icp_model (int i, const float *pts, const float *nv, int n)
+{
+  return icp.SetModel(i, pts, nv, n);
+}
+
+
+//= Load template "i" (0-7) from mesh with "nv" vertices and "nt" triangles.
+// returns number of points kept, 0 if bad slot
+
+extern "C" int tof_icp_mesh (int i, const float *verts, int nv, const int *tris, int nt)
+{
+  return icp.SetMesh(i, verts, nv, tris, nt);
+}
+
+
+//= Load template "i" (0-7) from a binary PLY file such as tof_mesh_save() makes.
+// returns number of points kept, 0 if file problem or bad slot
+
+extern "C" int tof_icp_load (int i, const char *fname)
+{
+  return icp.LoadPly(i, fname);
+}
+
+
+//= Set starting pose of template "i" as rotation "r" (row major) and shift "t".
+// returns 1 if okay, 0 if no template
+
+extern "C" int tof_icp_place (int i, const float *r, const float *t)
+{
+  return icp.SetPose(i, r, t);
+}
+
+
+//= Stop tracking and forget template "i".
+
+extern "C" void tof_icp_drop (int i)
+{
+  icp.Drop(i);
+}
+
+
+//= Refine template poses against image from last Range() call.
+// "objects" = 1 only matches template to pixels of objects on support plane
+// returns number of templates currently tracking
+
+extern "C" int tof_icp (int objects)
+{
+  if (update_cloud() <= 0)
+    return 0;
+  if (objects <= 0)
+    return icp.Update(cloud);
+  objs.Analyze(cloud);
+  return icp.Update(cloud, objs.Labels());
+}
+
+
+//= Get pose of template "i" from last tof_icp() call in camera frame.
+// "r" is row major rotation, "t" is shift (mm), also gets match fitness and rms
+// returns status (0 = empty, 1 = lost, 2 = tracking)
+
+extern "C" int tof_icp_pose (int i, float *r, float *t, float *fit, float *rms)
+{
+  *fit = icp.Fitness(i);
+  *rms = icp.Rms(i);
+  return icp.Pose(i, r, t);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                             Free Space                                  //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Find how far floor is clear in each image column of last Range() call.
+// needs correct camera height and tilt set by tof_pose()
+// returns number of columns where some floor was seen
+
+extern "C" int tof_free ()
+{
+  if (update_cloud() <= 0)
+    return 0;
+  return nav.Analyze(cloud);
+}
+
+
+//= Get free floor distance (mm) for each of 100 columns from last tof_free().
+
+extern "C" const float *tof_free_dist ()
+{
+  return nav.Free();
+}
+
+
+//= Get bearing (degrees, positive right) for each of 100 columns from last tof_free().
+
+extern "C" const float *tof_free_bearing ()
+{
+  return nav.Bearing();
+}
+
+
+//= Shortest free distance (mm) for bearings between "lf" and "rt" degrees.
+// returns -1 if no columns look in that direction
+
+extern "C" float tof_corridor (float lf, float rt)
+{
+  return nav.Corridor(lf, rt);
+}
+
+
+//= Build overhead height map and obstacle distances from last Range() call.
+// needs correct camera height and tilt set by tof_pose()
+// "dt" = 0 skips distance transform, "dmax" caps distances (mm)
+// returns number of obstacle cells
+
+extern "C" int tof_grid (int dt, float dmax)
+{
+  if (update_cloud() <= 0)
+    return 0;
+  grid.dt = dt;
+  if (dmax != grid.dmax)
+  {
+    grid.dmax = dmax;
+    grid.Reset();
+  }
+  return grid.Build(cloud);
+}
+
+
+//= Get 128 x 128 height map (mm) from last tof_grid() call.
+// row 0 is farthest forward, cells with no points are -32768
+
+extern "C" const short *tof_grid_height ()
+{
+  return grid.Height();
+}
+
+
+//= Get 128 x 128 map of distances (mm) to nearest obstacle from last tof_grid().
+
+extern "C" const float *tof_grid_dist ()
+{
+  return grid.Dist();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                          Collision Checking                             //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Freeze image from last Range() call and camera pose for collision queries.
+// queries can then run from any thread until next tof_pin() call
+// returns 1 if okay, 0 if no image
+
+extern "C" int tof_pin ()
+{
+  if (update_cloud() <= 0)
+    return 0;
+  return coll.Pin(tof.Last(), cloud);
+}
+
+
+//= Check "n" spheres (x, y, z, radius in mm) against last tof_pin() image.
+// "world" = 0 for camera frame, 1 for world frame of pinned pose
+// sets "hit" entries to 1 for possible collision, 0 for definitely free
+// returns number of spheres that might collide
+
+extern "C" int tof_spheres (unsigned char *hit, const float *xyzr, int n, int world)
+{
+  return coll.Spheres(hit, xyzr, n, world);
+}
+
+
+//= Check "n" capsules (ax, ay, az, bx, by, bz, radius) against tof_pin() image.
+// "world" = 0 for camera frame, 1 for world frame of pinned pose
+// sets "hit" entries to 1 for possible collision, 0 for definitely free
+// returns number of capsules that might collide
+
+extern "C" int tof_capsules (unsigned char *hit, const float *abr, int n, int world)
+{
+  return coll.Capsules(hit, abr, n, world);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                          Neighborhood Queries                           //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Update spatial hash of points in image from last Range() call.
+// "world" = 0 for camera frame, 1 for world frame, "cell" is bucket size (mm)
+// only points that changed since the last call are moved between buckets
+// returns number of points indexed
+
+extern "C" int tof_hash (int world, float cell)
+{
+  if (update_cloud() <= 0)
+    return 0;
+  if (cell != hash.sz)
+  {
+    hash.sz = cell;
+    hash.Reset();
+  }
+  return hash.Build(cloud, world);
+}
+
+
+//= Find up to "k" (max 100) points from last tof_hash() closest to "x", "y", "z".
+// only considers points within "rmax" (mm), results are closest first
+// saves pixel indices in "ids" and distances (mm) in "dist"
+// returns number of neighbors found
+
+extern "C" int tof_nearest (int *ids, float *dist, int k, float x, float y, float z, float rmax)
+{
+  return hash.Nearest(ids, dist, k, x, y, z, rmax);
+}
+
+
+//= Find points from last tof_hash() within "r" (mm) of "x", "y", "z".
+// saves at most "most" pixel indices in "ids" (in no particular order)
+// returns number of indices saved
+
+extern "C" int tof_radius (int *ids, int most, float x, float y, float z, float r)
+{
+  return hash.Radius(ids, most, x, y, z, r);
+}
+
+
+//= Get 10000 x 3 array of point coordinates indexed by last tof_hash() call.
+
+extern "C" const float *tof_hash_pts ()
+{
+  return hash.Points();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                            Plane Segmentation                           //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Find all large planes in image from last Range() call.
+// returns number of planes found
+
+extern "C" int tof_planes ()
+{
+  if (update_cloud() <= 0)
+    return 0;
+  return planes.Analyze(cloud);
+}
+
+
+//= Get plane "i" (1 to count) from last tof_planes() call in camera frame.
+// "n" receives 3 values of unit normal, n . p + d = 0 for points p (mm)
+// returns number of pixels on plane (0 if bad index)
+
+extern "C" int tof_plane (int i, float *n, float *d)
+{
+  const float *pn = planes.Normal(i);
+
+  if (pn == NULL)
+    return 0;
+  n[0] = pn[0];
+  n[1] = pn[1];
+  n[2] = pn[2];
+  *d = planes.Offset(i);
+  return planes.Pixels(i);
+}
+
+
+//= Get plane label image from last tof_planes() call.
+// 100 x 100 pixels of 16 bit plane numbers (0 = not planar)
+
+extern "C" const unsigned short *tof_plane_labels ()
+{
+  return planes.Labels();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                             Surface Mesh                                //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Triangulate point cloud from last Range() call into surface mesh.
+// "world" = 0 for camera frame, 1 for world frame (mm)
+// returns number of triangles made
+
+extern "C" int tof_mesh (int world)
+{
+  if (update_cloud() <= 0)
+    return 0;
+  return mesh.Build(cloud, world);
+}
+
+
+//= Number of vertices in mesh from last tof_mesh() call.
+
+extern "C" int tof_mesh_nv ()
+{
+  return mesh.Verts();
+}
+
+
+//= Get vertices from last tof_mesh() call.
+// tof_mesh_nv() points of 3 floats (x, y, z in mm)
+
+extern "C" const float *tof_mesh_verts ()
+{
+  return mesh.Vertex();
+}
+
+
+//= Get triangles from last tof_mesh() call.
+// tof_mesh() entries of 3 vertex indices (counter-clockwise from camera)
+
+extern "C" const int *tof_mesh_tris ()
+{
+  return mesh.Triangle();
+}
+
+
+//= Save mesh from last tof_mesh() call as a binary PLY file.
+// returns 1 if okay, 0 for file problem
+
+extern "C" int tof_mesh_save (const char *fname)
+{
+  return mesh.SavePly(fname);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//                           RGB Registration                              //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Describe external RGB camera for depth registration.
+// "w" x "h" image with focal lengths "fx", "fy" and center "cx", "cy" (pixels)
+// "k1" and "k2" are radial distortion, "rot" (row major) and "shift" (mm)
+// take depth camera points into RGB camera frame
+
+extern "C" void tof_rgb_setup (int w, int h, float fx, float fy, float cx, float cy, 
+                               float k1, float k2, const float *rot, const float *shift)
+{
+  int i;
+
+  rgb.rw = w;
+  rgb.rh = h;
+  rgb.fx = fx;
+  rgb.fy = fy;
+  rgb.ppx = cx;
+  rgb.ppy = cy;
+  rgb.k1 = k1;
+  rgb.k2 = k2;
+  for (i = 0; i < 9; i++)
+    rgb.rot[i] = rot[i];
+  for (i = 0; i < 3; i++)
+    rgb.shift[i] = shift[i];
+  rgb.flen = cloud.flen;
+  rgb.asp = cloud.asp;
+  rgb.Reset();
+}
+
+
+//= Get depth image from last Range() call as seen by RGB camera.
+// image is RGB size with depth along RGB axis (0.25mm, 65535 = unknown)
+// returns NULL if no image
+
+extern "C" const unsigned short *tof_rgb_depth ()
+{
+  if (rgb.Register(tof.Last()) <= 0)
+    return NULL;
+  return rgb.Depth();
+}
+
+
+//= Get size of registered depth image from last tof_rgb_depth() call.
+
+extern "C" void tof_rgb_size (int *w, int *h)
+{
+  *w = rgb.Width();
+  *h = rgb.Height();
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 //                          Debugging Functions                            //
 /////////////////////////////////////////////////////////////////////////////
@@ -116,3 +1075,30 @@ extern "C" const unsigned char *tof_night (int sh)
   return tof.Night(sh);
 }
 
+
+/////////////////////////////////////////////////////////////////////////////
+//                           Helper Functions                              //
+/////////////////////////////////////////////////////////////////////////////
+
+//= Make sure point cloud matches image from last Range() call.
+// returns number of valid points, 0 if no image
+
+static int update_cloud ()
+{
+  if (tof.Last() == NULL)
+    return 0;
+  if (tof.Stamp() != cvt)
+  {
+    cloud.Convert(tof.Last());
+    cvt = tof.Stamp();
+    if (autolev > 0)
+    {
+      // update pose from floor then redo world points
+      if (level.Update(cloud) > 0)
+        cloud.Convert(tof.Last());
+      else if (objs.FitPlane(cloud) > 0)
+        level.Seed(objs.Normal(), objs.Offset());
+    }
+  }
+  return cloud.Valid();
+}
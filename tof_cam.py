@@ -26,9 +26,10 @@
 # =========================================================================
 
 import numpy as np, cv2, os, sys
-from ctypes import CDLL, POINTER, cast, c_ubyte, c_void_p
+from ctypes import CDLL, POINTER, cast, byref, c_ubyte, c_short, c_ushort, c_int, c_void_p, c_longlong, c_float
 
-# serial port number (only matters for Windows)
+# serial port number (Windows COM number, Linux uses /dev/ttyUSB<port>
+# if that exists and otherwise falls back to /dev/ttyUSB0)
 port = 5
 
 # bind shared library
@@ -45,25 +46,78 @@ lib.tof_median.restype = c_void_p
 lib.tof_kalman.restype = c_void_p
 lib.tof_night.restype  = c_void_p
 
+# define return types of newer functions (older libraries may lack them)
+def bind(name, rtype):
+  if hasattr(lib, name):
+    getattr(lib, name).restype = rtype
+
+for f in ['tof_precise_depth', 'tof_precise_dev', 'tof_flow_img', 'tof_contact',
+          'tof_obj_labels', 'tof_plane_labels', 'tof_free_dist', 'tof_free_bearing',
+          'tof_grid_height', 'tof_grid_dist', 'tof_mesh_verts', 'tof_mesh_tris',
+          'tof_hash_pts', 'tof_rgb_depth', 'tof_events', 'tof_histogram',
+          'tof_range_sub', 'tof_contact_sub', 'tof_events_sub']:
+  bind(f, c_void_p)
+
+# define return types of frame information functions
+bind('tof_stamp', c_longlong)
+bind('tof_stamp_sub', c_longlong)
+for f in ['tof_stamp_err', 'tof_valid', 'tof_saturated', 'tof_noise',
+          'tof_motion', 'tof_ttc', 'tof_corridor']:
+  bind(f, c_float)
+
 
 # Python wrapper for A010 Time-of-Flight camera interface
 
 class TofCam:
 
-  # connect to Time-of-Flight sensor over USB
+  # connect to Time-of-Flight sensor over USB using global port number
+  # Windows COM number, Linux /dev/ttyUSB<port> (or /dev/ttyUSB0 if missing)
   # returns 1 if okay, 0 or negative for problem
 
   def Start(self):
     return lib.tof_start(port)
 
 
+  # play back a byte stream saved by Record instead of live sensor
+  # returns 1 if okay, 0 or negative for problem
+
+  def Replay(self, fname):
+    return lib.tof_replay(fname.encode())
+
+
+  # save exact received serial byte stream to a file (call before Start)
+  # recording stops with Done, cannot be changed while streaming
+  # returns 1 if file opened, 0 if not, negative if streaming
+
+  def Record(self, fname):
+    return lib.tof_record(fname.encode())
+
+
   # get 16 bit range image, possibly waiting for new frame (block = 1)
   # image is 100x100 pixels with depth in 0.25mm steps
   # image fmt: 0 = buffer pointer (int), 1 = OpenCV Mat (numpy ndarray)
+  # sub selects subscriber (analysis functions all use images from 0)
   # returns pointer to image or None if not ready or broken
 
-  def Range(self, block =0, fmt =1):
-    return self.fmt_pels(lib.tof_range(block), fmt, 16)
+  def Range(self, block =0, fmt =1, sub =0):
+    if sub == 0:
+      return self.fmt_pels(lib.tof_range(block), fmt, 16)
+    return self.fmt_pels(lib.tof_range_sub(block, sub), fmt, 16)
+
+
+  # add or change a subscriber wanting images at fps (0 = every frame)
+  # outs is a bit mask of optional outputs: 1 = time-to-contact, 2 = events
+  # uses given sub if not negative (0 is default) else picks a free one
+  # returns subscriber number, negative if none available
+
+  def Subscribe(self, fps =0.0, outs =3, sub =-1):
+    return lib.tof_subscribe(c_float(fps), outs, sub)
+
+
+  # stop delivering images to a subscriber
+
+  def Unsubscribe(self, sub):
+    lib.tof_unsubscribe(sub)
 
 
   # convert a pointer to a byte sequence into an image object
@@ -83,12 +137,428 @@ class TofCam:
     return img
 
 
+  # estimated capture time (ns since boot) of image from last Range call
+  # de-jittered using frame ids in sensor headers
+
+  def Stamp(self, sub =0):
+    if sub == 0:
+      return lib.tof_stamp()
+    return lib.tof_stamp_sub(sub)
+
+
+  # uncertainty (ms) in estimated capture time from last Range call
+
+  def StampErr(self):
+    return lib.tof_stamp_err()
+
+
+  # quality summary of image from last Range call (no pixel access needed)
+  # returns fraction valid, fraction saturated, mean variance (mm^2), 
+  #   fraction blanked for motion, and whether range step just changed
+
+  def Quality(self):
+    return (lib.tof_valid(), lib.tof_saturated(), lib.tof_noise(),
+            lib.tof_motion(), lib.tof_jump())
+
+
+  # histogram of 8 bit sensor values for image from last Range call
+  # roi: 0 = whole frame, 1 = auto-range ROI (bin 255 is saturated)
+  # returns 256 counts and depth (mm) of each bin, None if no image
+
+  def Histogram(self, roi =0):
+    step = c_int()
+    ptr = lib.tof_histogram(byref(step), roi)
+    if not ptr:
+      return None, 0
+    buf = cast(ptr, POINTER(c_int * 256))
+    return np.frombuffer(buf.contents, np.int32).copy(), step.value
+
+
+  # 10th, 50th, and 90th percentile depths (mm) for last Range call image
+  # roi: 0 = whole frame, 1 = auto-range ROI (values negative if none)
+
+  def DepthPercentiles(self, roi =0):
+    pcts = (c_float * 3)(-1.0, -1.0, -1.0)
+    lib.tof_depth_pcts(pcts, roi)
+    return pcts[0], pcts[1], pcts[2]
+
+
+  # shortest time-to-contact (sec) in ROI for image from last Range call
+  # returns time (negative if nothing approaching) and pixel x, y 
+
+  def Approach(self):
+    x, y = c_int(), c_int()
+    lib.tof_ttc_pos(byref(x), byref(y))
+    return lib.tof_ttc(), x.value, y.value
+
+
+  # time-to-contact map (ms) for image from last Range call
+  # pixels are 65535 where surface is not approaching
+  # image fmt: 0 = buffer pointer (int), 1 = OpenCV Mat (numpy ndarray)
+
+  def Contact(self, fmt =1, sub =0):
+    if sub == 0:
+      return self.fmt_pels(lib.tof_contact(), fmt, 16)
+    return self.fmt_pels(lib.tof_contact_sub(sub), fmt, 16)
+
+
+  # configure change events: blk = 1 (pixels) or 4 (4x4 blocks)
+  # tol = min depth change (mm), key = frames between full lists (0 = once)
+
+  def EventMode(self, blk =1, tol =10.0, key =100):
+    lib.tof_events_cfg(blk, c_float(tol), key)
+
+
+  # changed cells for image from last Range call as 16 bit words
+  # grid width, full flag, then runs of start, count, and count depths
+
+  def Events(self, sub =0):
+    n = c_int()
+    if sub == 0:
+      ptr = lib.tof_events(byref(n))
+    else:
+      ptr = lib.tof_events_sub(byref(n), sub)
+    if not ptr:
+      return None
+    buf = cast(ptr, POINTER(c_ushort * n.value))
+    return np.frombuffer(buf.contents, np.uint16).copy()
+
+
   # cleanly disconnect imaging depth sensor
 
   def Done(self):
     lib.tof_done()
 
 
+  # collect n frames at fixed range step and robustly average each pixel
+  # drops trim percent of samples at each end (50 gives median)
+  # returns 16 bit depth and standard deviation images (0.25mm units)
+  # image fmt: 0 = buffer pointer (int), 1 = OpenCV Mat (numpy ndarray)
+
+  def Precise(self, n =30, trim =10, fmt =1):
+    if lib.tof_precise(n, trim, 1) <= 0:
+      return None, None
+    dep = self.fmt_pels(lib.tof_precise_depth(), fmt, 16)
+    dev = self.fmt_pels(lib.tof_precise_dev(), fmt, 16)
+    return dep, dev
+
+
+  # set position (mm) and orientation (degrees) of camera relative to floor
+  # world frame has X to right, Y forward, and Z up from floor
+
+  def Pose(self, x =0.0, y =0.0, z =0.0, pan =0.0, tilt =0.0, roll =0.0):
+    lib.tof_pose(c_float(x), c_float(y), c_float(z), 
+                 c_float(pan), c_float(tilt), c_float(roll))
+
+
+  # set camera pose from entry for sensor in file written by tof_calib
+  # returns 1 if okay, 0 if sensor or file not found
+
+  def LoadPose(self, fname, sensor =0):
+    return lib.tof_calib_load(fname.encode(), sensor)
+
+
+  # automatically adjust camera tilt, roll, and height from floor (on = 1)
+  # starts from values given to Pose (if z > 0) else from dominant plane
+
+  def AutoLevel(self, on =1):
+    lib.tof_autolevel(on)
+
+
+  # camera tilt and roll (degrees) and height (mm) found by auto-leveling
+  # status is 1 if big change in last image, 0 if steady, -1 if not tracking
+
+  def Level(self):
+    tilt, roll, ht = c_float(), c_float(), c_float()
+    status = lib.tof_level(byref(tilt), byref(roll), byref(ht))
+    return tilt.value, roll.value, ht.value, status
+
+
+  # 3D motion (mm in camera frame) of each pixel since previous call
+  # uses image from last Range call (call once per frame)
+  # returns 100 x 100 x 3 array of signed 16 bit values (None at start)
+  # image fmt: 0 = buffer pointer (int), 1 = numpy ndarray
+
+  def Flow(self, fmt =1):
+    if lib.tof_flow() <= 0:
+      return None
+    ptr = lib.tof_flow_img()
+    if fmt <= 0:
+      return ptr
+    buf = cast(ptr, POINTER(c_short * 30000))
+    img = np.frombuffer(buf.contents, np.int16)
+    img.shape = (100, 100, 3)
+    return img
+
+
+  # find objects sitting on dominant plane in image from last Range call
+  # returns list of (volume mm^3, footprint mm^2, max height mm) tuples
+  # and 16 bit label image where pixel value is list index + 1 (0 = none)
+
+  def Objects(self, fmt =1):
+    vol, area, ht = c_float(), c_float(), c_float()
+    sizes = []
+    for i in range(1, lib.tof_objects() + 1):
+      lib.tof_object(i, byref(vol), byref(area), byref(ht))
+      sizes.append((vol.value, area.value, ht.value))
+    return sizes, self.fmt_pels(lib.tof_obj_labels(), fmt, 16)
+
+
+  # propose top-down grasps for objects found in image from last Range call
+  # returns list of (object number, grasp point, jaw closing direction, 
+  #   width between jaws mm, free space outside jaws mm) and approach direction
+  # points and directions are (x, y, z) tuples in camera frame
+
+  def Grasps(self):
+    pos, dir = (c_float * 3)(), (c_float * 3)()
+    wid, clr = c_float(), c_float()
+    grasps = []
+    for i in range(1, lib.tof_grasps() + 1):
+      obj = lib.tof_grasp(i, pos, dir, byref(wid), byref(clr))
+      grasps.append((obj, tuple(pos), tuple(dir), wid.value, clr.value))
+    lib.tof_grasp_approach(dir)
+    return grasps, tuple(dir)
+
+
+  # fit box or upright cylinder to objects found in image from last Range call
+  # returns list of ("box" or "cylinder", base center, axis, (length, width,
+  #   height), (box rms error, cylinder rms error)) in camera frame (mm)
+  # axis is long direction of box or up direction of cylinder
+
+  def Shapes(self):
+    ctr, axis, dims, err = (c_float * 3)(), (c_float * 3)(), (c_float * 3)(), (c_float * 2)()
+    shapes = []
+    for i in range(1, lib.tof_shapes() + 1):
+      kind = lib.tof_shape(i, ctr, axis, dims, err)
+      shapes.append((("box" if kind == 1 else "cylinder"), tuple(ctr), tuple(axis),
+                     tuple(dims), tuple(err)))
+    return shapes
+
+
+  # load template slot i (0-7) with N x 3 points and optional N x 3 normals
+  # returns number of points kept (max 2000)
+
+  def Template(self, i, pts, normals =None):
+    p = np.ascontiguousarray(pts, np.float32).reshape(-1, 3)
+    if normals is None:
+      return lib.tof_icp_model(i, p.ctypes.data_as(POINTER(c_float)), None, p.shape[0])
+    nv = np.ascontiguousarray(normals, np.float32).reshape(-1, 3)
+    return lib.tof_icp_model(i, p.ctypes.data_as(POINTER(c_float)),
+                             nv.ctypes.data_as(POINTER(c_float)), p.shape[0])
+
+
+  # load template slot i (0-7) from N x 3 vertices and M x 3 triangle indices
+  # returns number of points kept (max 2000)
+
+  def TemplateMesh(self, i, verts, tris):
+    v = np.ascontiguousarray(verts, np.float32).reshape(-1, 3)
+    t = np.ascontiguousarray(tris, np.int32).reshape(-1, 3)
+    return lib.tof_icp_mesh(i, v.ctypes.data_as(POINTER(c_float)), v.shape[0],
+                            t.ctypes.data_as(POINTER(c_int)), t.shape[0])
+
+
+  # load template slot i (0-7) from a PLY file like SaveMesh makes
+  # returns number of points kept, 0 if file problem
+
+  def LoadTemplate(self, i, fname):
+    return lib.tof_icp_load(i, fname.encode())
+
+
+  # set starting pose of template i as 3 x 3 rotation and shift (mm)
+  # template point m appears in camera frame at rot @ m + shift
+
+  def PlaceTemplate(self, i, rot, shift):
+    r = (c_float * 9)(*np.asarray(rot, np.float32).ravel())
+    t = (c_float * 3)(*np.asarray(shift, np.float32).ravel())
+    return lib.tof_icp_place(i, r, t)
+
+
+  # stop tracking template i and forget it
+
+  def DropTemplate(self, i):
+    lib.tof_icp_drop(i)
+
+
+  # refine all template poses in image from last Range call
+  # objects: 1 = only match pixels of objects on support plane
+  # returns 8 entries of (status, rotation, shift, fitness, rms) or None if empty
+  # status is 1 if lost, 2 if tracking
+
+  def Track(self, objects =1):
+    r, t, fit, rms = (c_float * 9)(), (c_float * 3)(), c_float(), c_float()
+    lib.tof_icp(objects)
+    poses = []
+    for i in range(8):
+      st = lib.tof_icp_pose(i, r, t, byref(fit), byref(rms))
+      if st <= 0:
+        poses.append(None)
+        continue
+      poses.append((st, np.array(r[:], np.float32).reshape(3, 3), np.array(t[:], np.float32),
+                    fit.value, rms.value))
+    return poses
+
+
+  # how far floor is clear in each image column for last Range call (needs Pose)
+  # returns 100 free distances (mm) and bearings (degrees, positive right)
+
+  def FreeSpace(self):
+    lib.tof_free()
+    dist = cast(lib.tof_free_dist(), POINTER(c_float * 100))
+    bear = cast(lib.tof_free_bearing(), POINTER(c_float * 100))
+    return (np.frombuffer(dist.contents, np.float32).copy(),
+            np.frombuffer(bear.contents, np.float32).copy())
+
+
+  # shortest free distance (mm) for bearings between lf and rt degrees
+  # uses results of last FreeSpace call (-1 if no columns in range)
+
+  def Corridor(self, lf, rt):
+    return lib.tof_corridor(c_float(lf), c_float(rt))
+
+
+  # overhead 128 x 128 grid for last Range call (needs Pose) with 20mm cells
+  # row 0 is farthest forward, center column is straight ahead of camera
+  # returns height map (mm, -32768 = unseen) and distance to nearest
+  #   obstacle (mm, capped at dmax) or None if dt = 0
+
+  def Grid(self, dt =1, dmax =500.0):
+    lib.tof_grid(dt, c_float(dmax))
+    hbuf = cast(lib.tof_grid_height(), POINTER(c_short * 16384))
+    hmap = np.frombuffer(hbuf.contents, np.int16).reshape(128, 128).copy()
+    if dt <= 0:
+      return hmap, None
+    dbuf = cast(lib.tof_grid_dist(), POINTER(c_float * 16384))
+    return hmap, np.frombuffer(dbuf.contents, np.float32).reshape(128, 128).copy()
+
+
+  # freeze image from last Range call for later collision queries
+  # returns 1 if okay, 0 if no image
+
+  def Pin(self):
+    return lib.tof_pin()
+
+
+  # check N x 4 array of spheres (x, y, z, radius in mm) against pinned image
+  # world: 0 = camera frame, 1 = world frame (mm)
+  # returns boolean array which is True where sphere might collide
+
+  def Spheres(self, xyzr, world =0):
+    return self.collide(lib.tof_spheres, xyzr, 4, world)
+
+
+  # check N x 7 array of capsules (end a, end b, radius) against pinned image
+  # world: 0 = camera frame, 1 = world frame (mm)
+  # returns boolean array which is True where capsule might collide
+
+  def Capsules(self, abr, world =0):
+    return self.collide(lib.tof_capsules, abr, 7, world)
+
+
+  # run batched collision function "fcn" on array with "w" values per entry
+
+  def collide(self, fcn, vals, w, world):
+    v = np.ascontiguousarray(vals, np.float32).reshape(-1, w)
+    n = v.shape[0]
+    hit = np.zeros(n, np.uint8)
+    fcn(hit.ctypes.data_as(POINTER(c_ubyte)), v.ctypes.data_as(POINTER(c_float)), n, world)
+    return hit > 0
+
+
+  # index points from last Range call for neighborhood queries
+  # world: 0 = camera frame, 1 = world frame, cell = bucket size (mm)
+  # returns number of points indexed
+
+  def Hash(self, world =0, cell =20.0):
+    return lib.tof_hash(world, c_float(cell))
+
+
+  # find up to k (max 100) indexed points within rmax (mm) of 3D point pt
+  # returns pixel indices, distances, and N x 3 coordinates (closest first)
+
+  def Nearest(self, pt, k =1, rmax =100.0):
+    ids, dist = (c_int * 100)(), (c_float * 100)()
+    n = lib.tof_nearest(ids, dist, k, c_float(pt[0]), c_float(pt[1]), c_float(pt[2]), c_float(rmax))
+    pix = np.array(ids[:n], np.int32)
+    return pix, np.array(dist[:n], np.float32), self.hash_pts(pix)
+
+
+  # find at most "most" indexed points within r (mm) of 3D point pt
+  # returns pixel indices and N x 3 coordinates (in no particular order)
+
+  def Within(self, pt, r, most =10000):
+    ids = (c_int * most)()
+    n = lib.tof_radius(ids, most, c_float(pt[0]), c_float(pt[1]), c_float(pt[2]), c_float(r))
+    pix = np.array(ids[:n], np.int32)
+    return pix, self.hash_pts(pix)
+
+
+  # get coordinates of indexed points for pixel indices "pix"
+
+  def hash_pts(self, pix):
+    buf = cast(lib.tof_hash_pts(), POINTER(c_float * 30000))
+    return np.frombuffer(buf.contents, np.float32).reshape(10000, 3)[pix].copy()
+
+
+  # find all large planes (floor, walls, shelves) in image from last Range call
+  # returns list of (nx, ny, nz, d) tuples with n . p + d = 0 in camera frame
+  # and 16 bit label image where pixel value is list index + 1 (0 = none)
+
+  def Planes(self, fmt =1):
+    n, d = (c_float * 3)(), c_float()
+    eqns = []
+    for i in range(1, lib.tof_planes() + 1):
+      lib.tof_plane(i, n, byref(d))
+      eqns.append((n[0], n[1], n[2], d.value))
+    return eqns, self.fmt_pels(lib.tof_plane_labels(), fmt, 16)
+
+
+  # triangulate image from last Range call into surface mesh
+  # world: 0 = camera frame, 1 = world frame (mm)
+  # returns N x 3 float vertex array and M x 3 int vertex index array
+
+  def Mesh(self, world =0):
+    nt = lib.tof_mesh(world)
+    nv = lib.tof_mesh_nv()
+    if (nt <= 0) or (nv <= 0):
+      return None, None
+    vbuf = cast(lib.tof_mesh_verts(), POINTER(c_float * (3 * nv)))
+    tbuf = cast(lib.tof_mesh_tris(), POINTER(c_int * (3 * nt)))
+    verts = np.frombuffer(vbuf.contents, np.float32).reshape(nv, 3).copy()
+    tris = np.frombuffer(tbuf.contents, np.int32).reshape(nt, 3).copy()
+    return verts, tris
+
+
+  # save mesh from last Mesh call as a binary PLY file
+  # returns 1 if okay, 0 for file problem
+
+  def SaveMesh(self, fname):
+    return lib.tof_mesh_save(fname.encode())
+
+
+  # describe external RGB camera for depth registration (pixels and mm)
+  # rot and shift take depth camera points into RGB camera frame
+  # k1 and k2 are radial distortion coefficients (as in OpenCV)
+
+  def RgbSetup(self, w, h, fx, fy, cx, cy, rot =np.eye(3), shift =(0, 0, 0), k1 =0.0, k2 =0.0):
+    r = (c_float * 9)(*np.asarray(rot, np.float32).ravel())
+    t = (c_float * 3)(*np.asarray(shift, np.float32).ravel())
+    lib.tof_rgb_setup(w, h, c_float(fx), c_float(fy), c_float(cx), c_float(cy),
+                      c_float(k1), c_float(k2), r, t)
+
+
+  # get depth image from last Range call aligned with RGB camera
+  # image is RGB size with 16 bit depth in 0.25mm steps (65535 = unknown)
+
+  def RgbDepth(self):
+    w, h = c_int(), c_int()
+    ptr = lib.tof_rgb_depth()
+    if not ptr:
+      return None
+    lib.tof_rgb_size(byref(w), byref(h))
+    buf = cast(ptr, POINTER(c_ushort * (w.value * h.value)))
+    return np.frombuffer(buf.contents, np.uint16).reshape(h.value, w.value).copy()
+
+
   # -------------------------------------------------------------------------
 
   # current range step (in mm) used by hardware sensor